@@ -7,12 +7,67 @@
 
 #include "constants.h"
 
+#define READ_BUFFER_SIZE 65536
+
+// Buffer de leitura, evita uma chamada a read() por cada caracter
+struct Reader {
+  int fd;      // File descriptor associado ao buffer
+  size_t pos;  // Próximo caracter a consumir
+  size_t len;  // Número de caracteres válidos no buffer
+  char buf[READ_BUFFER_SIZE];
+};
+
+static struct Reader reader = {.fd = -1, .pos = 0, .len = 0};
+
+/// Reads the next character of the given file descriptor.
+/// @note The buffer is refilled in chunks of READ_BUFFER_SIZE bytes and is
+/// reset when a different file descriptor is used or the end is reached.
+/// @param fd File descriptor to read from.
+/// @param ch Pointer to the variable to store the character in.
+/// @return 1 if a character was read, 0 at the end of the file, -1 on error.
+static int read_char(int fd, char *ch) {
+  if (reader.fd != fd) {
+    reader.fd = fd;
+    reader.pos = 0;
+    reader.len = 0;
+  }
+
+  if (reader.pos == reader.len) {
+    ssize_t read_bytes = read(fd, reader.buf, READ_BUFFER_SIZE);
+    if (read_bytes <= 0) {
+      reader.fd = -1;
+      reader.pos = 0;
+      reader.len = 0;
+      return read_bytes == 0 ? 0 : -1;
+    }
+    reader.pos = 0;
+    reader.len = (size_t)read_bytes;
+  }
+
+  *ch = reader.buf[reader.pos++];
+  return 1;
+}
+
+/// Reads up to size characters, behaving like read on a regular file.
+/// @param fd File descriptor to read from.
+/// @param buf Buffer to store the characters in.
+/// @param size Number of characters to read.
+/// @return Number of characters read.
+static size_t read_chars(int fd, char *buf, size_t size) {
+  size_t i = 0;
+  while (i < size && read_char(fd, &buf[i]) == 1) {
+    i++;
+  }
+  return i;
+}
+
 static int read_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
   int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (read_char(fd, buf + i) != 1) {
+      buf[i] = '\0';
       *next = '\0';
       break;
     }
@@ -40,19 +95,19 @@ static int read_uint(int fd, unsigned int *value, char *next) {
 
 static void cleanup(int fd) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (read_char(fd, &ch) == 1 && ch != '\n')
     ;
 }
 
 enum Command get_next(int fd) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (read_char(fd, buf) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+      if (read_chars(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -60,7 +115,7 @@ enum Command get_next(int fd) {
       return CMD_CREATE;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
+      if (read_chars(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -68,7 +123,7 @@ enum Command get_next(int fd) {
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+      if (read_chars(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -76,12 +131,12 @@ enum Command get_next(int fd) {
       return CMD_SHOW;
 
     case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
+      if (read_chars(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (read_chars(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -89,12 +144,12 @@ enum Command get_next(int fd) {
       return CMD_LIST_EVENTS;
 
     case 'B':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+      if (read_chars(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
+      if (read_chars(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -102,7 +157,7 @@ enum Command get_next(int fd) {
       return CMD_BARRIER;
 
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+      if (read_chars(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -110,12 +165,12 @@ enum Command get_next(int fd) {
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+      if (read_chars(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (read_chars(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -168,14 +223,14 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
+  if (read_char(fd, &ch) != 1 || ch != '[') {
     cleanup(fd);
     return 0;
   }
 
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
+    if (read_char(fd, &ch) != 1 || ch != '(') {
       cleanup(fd);
       return 0;
     }
@@ -196,7 +251,7 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
+    if (read_char(fd, &ch) != 1 || (ch != ' ' && ch != ']')) {
       cleanup(fd);
       return 0;
     }
@@ -211,7 +266,7 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+  if (read_char(fd, &ch) != 1 || (ch != '\n' && ch != '\0')) {
     cleanup(fd);
     return 0;
   }
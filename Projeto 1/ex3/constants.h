@@ -1,2 +1,8 @@
-#define MAX_RESERVATION_SIZE 256
+// Pode ser aumentado na compilação (-DMAX_RESERVATION_SIZE=...): a ordenação
+// dos lugares é linear, mas cada thread guarda 16 bytes por lugar na pilha
+#ifndef MAX_RESERVATION_SIZE
+#define MAX_RESERVATION_SIZE 4096
+#endif
 #define STATE_ACCESS_DELAY_MS 10
+// Cópias dos lugares que um SHOW tenta sem travar as reservas do evento
+#define SHOW_OPTIMISTIC_TRIES 2
@@ -1,19 +1,162 @@
 #include "eventlist.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 
+#define INDEX_INITIAL_CAPACITY 64
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+static struct EventIndex* create_index(size_t capacity) {
+  struct EventIndex* index = (struct EventIndex*)malloc(sizeof(struct EventIndex));
+  if (!index) return NULL;
+
+  index->slots = calloc(capacity, sizeof(_Atomic(struct Event*)));
+  if (!index->slots) {
+    free(index);
+    return NULL;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&index->slots[i], NULL);
+  }
+  index->capacity = capacity;
+  index->count = 0;
+  index->retired = NULL;
+  return index;
+}
+
+static void free_index(struct EventIndex* index) {
+  while (index) {
+    struct EventIndex* retired = index->retired;
+    free(index->slots);
+    free(index);
+    index = retired;
+  }
+}
+
+/// Fibonacci hashing, spreads sequential ids over the table.
+static size_t hash_id(unsigned int event_id, size_t capacity) {
+  return (size_t)(((uint64_t)event_id * 11400714819323198485ULL) >> 32) & (capacity - 1);
+}
+
+static void index_insert(struct EventIndex* index, struct Event* event) {
+  size_t i = hash_id(event->id, index->capacity);
+  while (atomic_load_explicit(&index->slots[i], memory_order_relaxed) != NULL) {
+    i = (i + 1) & (index->capacity - 1);
+  }
+  // Publica o evento já inicializado para os leitores
+  atomic_store_explicit(&index->slots[i], event, memory_order_release);
+  index->count++;
+}
+
+/// Doubles the index and publishes the new table. The old one is kept alive
+/// until free_list, since lock-free readers may still be probing it.
+static struct EventIndex* grow_index(struct EventIndex* index) {
+  struct EventIndex* bigger = create_index(index->capacity * 2);
+  if (!bigger) return NULL;
+
+  for (size_t i = 0; i < index->capacity; i++) {
+    struct Event* event = atomic_load_explicit(&index->slots[i], memory_order_relaxed);
+    if (event) index_insert(bigger, event);
+  }
+  bigger->retired = index;
+  return bigger;
+}
+
+/// Rounds size up to a multiple of the strictest fundamental alignment.
+static size_t align_size(size_t size) {
+  size_t align = _Alignof(max_align_t);
+  return (size + align - 1) & ~(align - 1);
+}
+
+/// Hands out size bytes from the arena of the list, adding a block when the
+/// current one is full. The memory is only given back with the whole arena.
+static void* arena_alloc(struct EventList* list, size_t size) {
+  size = align_size(size);
+  struct ArenaBlock* block = list->arena;
+
+  if (block == NULL || block->size - block->used < size) {
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    struct ArenaBlock* new_block = malloc(sizeof(struct ArenaBlock) + block_size);
+    if (!new_block) return NULL;
+    new_block->size = block_size;
+    new_block->used = 0;
+
+    // Um bloco só para um evento grande fica atrás do atual, que continua a
+    // ser usado para os pequenos
+    if (block != NULL && block_size > ARENA_BLOCK_SIZE) {
+      new_block->next = block->next;
+      block->next = new_block;
+    } else {
+      new_block->next = block;
+      list->arena = new_block;
+    }
+    block = new_block;
+  }
+
+  void* ptr = (char*)block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+static void free_arena(struct ArenaBlock* block) {
+  while (block) {
+    struct ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
+  struct EventIndex* index = create_index(INDEX_INITIAL_CAPACITY);
+  if (!index) {
+    free(list);
+    return NULL;
+  }
+  atomic_init(&list->index, index);
   list->head = NULL;
   list->tail = NULL;
+  list->arena = NULL;
   return list;
 }
 
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (!list) return NULL;
+  size_t header = align_size(sizeof(struct Event));
+  if (num_cols != 0 && num_rows > (SIZE_MAX - header) / sizeof(_Atomic unsigned int) / num_cols) return NULL;
+
+  size_t num_seats = num_rows * num_cols;
+  struct Event* event = arena_alloc(list, header + num_seats * sizeof(_Atomic unsigned int));
+  if (!event) return NULL;
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  atomic_init(&event->started, 0);
+  atomic_init(&event->finished, 0);
+  atomic_init(&event->gate, 0);
+  event->data = (_Atomic unsigned int*)((char*)event + header);
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_init(&event->data[i], 0);
+  }
+  return event;
+}
+
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  // Mantém o fator de carga abaixo de 1/2
+  if ((index->count + 1) * 2 > index->capacity) {
+    struct EventIndex* bigger = grow_index(index);
+    if (!bigger) return 1;
+    atomic_store_explicit(&list->index, bigger, memory_order_release);
+    index = bigger;
+  }
+
+  struct ListNode* new_node = arena_alloc(list, sizeof(struct ListNode));
   if (!new_node) return 1;
 
   new_node->event = event;
@@ -27,49 +170,62 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  index_insert(index, event);
   return 0;
 }
 
-static void free_event(struct Event* event) {
-  if (!event) return;
-  long unsigned size = (event->cols)*(event->rows);
-  for(int i = 0; i < (int)size; i++) {
-    pthread_mutex_destroy(&event->mutexes[i]);
-  }
-  pthread_mutex_destroy(&event->event_mutex);
-
-  free(event->data);
-  free(event->mutexes);
-  free(event);
-}
-
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct ListNode* temp = current;
-    current = current->next;
+  // Os nós, eventos e lugares estão todos na arena
+  free_arena(list->arena);
+  free_index(atomic_load(&list->index));
+  free(list);
+}
+
+int reset_list(struct EventList* list) {
+  if (!list) return 1;
 
-    free_event(temp->event);
-    free(temp);
+  struct EventIndex* index = create_index(INDEX_INITIAL_CAPACITY);
+  if (!index) return 1;
+  free_index(atomic_load(&list->index));
+  atomic_store(&list->index, index);
+
+  // Guarda o primeiro bloco de tamanho normal, os restantes são libertados
+  struct ArenaBlock* keep = NULL;
+  struct ArenaBlock* block = list->arena;
+  while (block) {
+    struct ArenaBlock* next = block->next;
+    if (keep == NULL && block->size == ARENA_BLOCK_SIZE) {
+      keep = block;
+      keep->next = NULL;
+      keep->used = 0;
+    } else {
+      free(block);
+    }
+    block = next;
   }
-  //free(current);
-
-  free(list);
+  list->arena = keep;
+  list->head = NULL;
+  list->tail = NULL;
+  return 0;
 }
 
 struct Event* get_event(struct EventList* list, unsigned int event_id) {
   if (!list) return NULL;
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_acquire);
+
+  size_t i = hash_id(event_id, index->capacity);
+  while (1) {
+    struct Event* event = atomic_load_explicit(&index->slots[i], memory_order_acquire);
+    if (event == NULL) {
+      return NULL;
+    }
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct Event* event = current->event;
     if (event->id == event_id) {
       return event;
     }
-    current = current->next;
-  }
 
-  return NULL;
+    i = (i + 1) & (index->capacity - 1);
+  }
 }
@@ -2,20 +2,29 @@
 #define EVENT_LIST_H
 #define BUFFER 10000
 
+#include <limits.h>
 #include <stddef.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 
+/// Value of a seat claimed by a reservation still in progress.
+#define SEAT_CLAIMED UINT_MAX
+
 struct Event {
-  unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  unsigned int id;                     /// Event id
+  _Atomic unsigned int reservations;  /// Number of reservations for the event.
+
+  // As reservas contam quando começam e acabam de mexer nos lugares: um SHOW
+  // só aceita a cópia dos lugares se nenhuma reserva esteve a meio
+  _Atomic unsigned int started;   /// Reservations that began changing the seats.
+  _Atomic unsigned int finished;  /// Reservations done changing the seats, kept or rolled back.
+  _Atomic unsigned int gate;      /// SHOWs holding new reservations back to copy the seats.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
-  pthread_mutex_t* mutexes;/// Array of size rows * cols with the mutex for each seat.
-  pthread_mutex_t event_mutex; /// Mutex for the event.
+  _Atomic unsigned int* data;  /// Array of size rows * cols with the reservations for each seat.
 };
 
 struct ListNode {
@@ -23,28 +32,62 @@ struct ListNode {
   struct ListNode* next;
 };
 
+// Open addressing hash table indexing the events by id
+struct EventIndex {
+  size_t capacity;                // Number of slots (power of two)
+  size_t count;                   // Number of occupied slots
+  _Atomic(struct Event*)* slots;  // Slots, NULL when empty
+  struct EventIndex* retired;     // Previous (smaller) table, freed with the list
+};
+
+// Block of the arena the nodes, events and seats are allocated from
+struct ArenaBlock {
+  struct ArenaBlock* next;  // Next block, NULL for the last
+  size_t size;              // Number of usable bytes in data
+  size_t used;              // Number of bytes already handed out
+  max_align_t data[];
+};
+
 // Linked list structure
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
+  struct ListNode* head;              // Head of the list
+  struct ListNode* tail;              // Tail of the list
+  _Atomic(struct EventIndex*) index;  // Hash index by event id
+  struct ArenaBlock* arena;           // Memory of every node, event and seat, freed all at once
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Creates an event with every seat free, with its seats right after it in
+/// the arena of the list. The event is only visible after append_to_list.
+/// @note Must be serialized with append_to_list by the caller.
+/// @param list Event list whose arena holds the event.
+/// @param event_id Id of the event.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+/// @return Newly created event, NULL on failure.
+struct Event* create_event(struct EventList* list, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Appends a new node to the list and indexes it by id.
+/// @note Appends must be serialized by the caller; lookups may run concurrently.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
-/// Removes a node from the list.
-/// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// Frees the list, its events and its index.
+/// @param list Event list to be freed.
 void free_list(struct EventList* list);
 
+/// Removes every event from the list, keeping one arena block for reuse.
+/// @param list Event list to be emptied.
+/// @return 0 if the list was emptied successfully, 1 otherwise.
+int reset_list(struct EventList* list);
+
 /// Retrieves an event in the list.
+/// @note Does not require any lock, even with a concurrent append.
 /// @param list Event list to be searched
 /// @param event_id Event id.
 /// @return Pointer to the event if found, NULL otherwise.
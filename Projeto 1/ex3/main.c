@@ -1,4 +1,6 @@
+#include <errno.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -17,6 +19,51 @@
 #define TRUE 1
 #define FALSE 0
 
+/// Name of a .jobs file, sent to the workers through the pipe. Writes of at
+/// most PIPE_BUF bytes are atomic, so each name is read whole by one worker.
+struct JobFile {
+  char name[NAME_MAX + 1];
+};
+
+_Static_assert(sizeof(struct JobFile) <= PIPE_BUF, "JobFile must fit in an atomic pipe write");
+
+/// Executes the .jobs files read from the pipe until it is closed, reusing
+/// the EMS state of the process across files.
+/// @return 0 if every file was executed successfully, 1 otherwise.
+static int run_worker(int fd, char *dirpath, int max_threads) {
+  int failed = 0;
+  struct JobFile job;
+
+  while (1) {
+    ssize_t bytes_read = read(fd, &job, sizeof(job));
+    if (bytes_read == 0) {
+      break;
+    }
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read != (ssize_t) sizeof(job)) {
+      fprintf(stderr, "Failed to read from pipe\n");
+      failed = 1;
+      break;
+    }
+
+    job.name[NAME_MAX] = '\0';
+    if (ems_execute_child(job.name, dirpath, max_threads)) {
+      fprintf(stderr, "Failed to execute\n");
+      failed = 1;
+    }
+
+    // Cada ficheiro começa sem eventos
+    if (ems_reset()) {
+      return 1;
+    }
+  }
+
+  ems_terminate();
+  return failed;
+}
+
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
 
@@ -41,73 +88,74 @@ int main(int argc, char *argv[]) {
   int MAX_PROC = atoi(argv[2]);
   int MAX_THREADS = atoi(argv[3]);
 
+  if (MAX_PROC <= 0 || MAX_THREADS <= 0) {
+    fprintf(stderr, "Invalid number of processes or threads\n");
+    return 1;
+  }
+
   DIR *dir = opendir(dirpath);
   if (dir == NULL) {
     fprintf(stderr, "Failed to open directory\n");
     return 1;
   }
 
-  struct dirent *dp;
+  // Os workers recebem os nomes dos ficheiros ".jobs" por esta pipe
+  int jobs_pipe[2];
+  if (pipe(jobs_pipe) == -1) {
+    fprintf(stderr, "Failed to create pipe\n");
+    return 1;
+  }
+
+  for (int i = 0; i < MAX_PROC; i++) {
+    pid_t pid = fork();
+
+    if (pid == -1) {
+      fprintf(stderr, "Failed to create a child process\n");
+      exit(EXIT_FAILURE);
+    }
+    else if (pid == 0) {
+      closedir(dir);
+      close(jobs_pipe[1]);
+      int result = run_worker(jobs_pipe[0], dirpath, MAX_THREADS);
+      close(jobs_pipe[0]);
+      exit(result ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+  }
+  close(jobs_pipe[0]);
 
+  // Se todos os workers terminarem, write falha com EPIPE em vez de matar o processo
+  signal(SIGPIPE, SIG_IGN);
+
+  struct dirent *dp;
   while ((dp = readdir(dir)) != NULL) {
-    
     // Encontra os ficheiros com extensão ".jobs"
     if (strstr(dp->d_name, ".jobs") != NULL) {
-      static int activeProcesses = 0;
-      pid_t pid = fork();
-       
-      if(pid == -1) {
-        fprintf(stderr, "Failed to create a child process\n");
-        exit(EXIT_FAILURE);
-      }
-      else if (pid == 0) {
-        if(ems_execute_child(dp, dirpath, MAX_THREADS)) {
-          fprintf(stderr, "Failed to execute\n");
-          exit(EXIT_FAILURE);
-        }
-        exit(EXIT_SUCCESS);
-      }
-
-      if (pid > 0) {
-        activeProcesses++;
-        //Espera a conclusão do processo filho se atingir o número máximo de processos ativos
-        if(activeProcesses >= MAX_PROC) {
-          int status;
-          pid_t terminated_pid = wait(&status);
-          if (terminated_pid == -1) {
-            fprintf(stderr, "Failed to wait for child process\n");
-            exit(EXIT_FAILURE);
-          }
-
-          if (WIFEXITED(status)) {
-              printf("Processo filho %d terminado com estado %d\n", terminated_pid, WEXITSTATUS(status));
-          }
-          else if (WIFSIGNALED(status)) {
-              printf("Processo filho %d terminado por signal %d\n", terminated_pid, WTERMSIG(status));
-          }
-
-          activeProcesses--;
-        }
+      struct JobFile job;
+      memset(&job, 0, sizeof(job));
+      strncpy(job.name, dp->d_name, NAME_MAX);
+
+      // Bloqueia enquanto a pipe estiver cheia, ou seja, enquanto os workers estiverem ocupados
+      if (write(jobs_pipe[1], &job, sizeof(job)) != (ssize_t) sizeof(job)) {
+        fprintf(stderr, "Failed to send file to the workers\n");
+        break;
       }
     }
-
-    // Espera a conclusão dos processos filhos restantes
-    int status = 0;
-    pid_t terminated_pid;
-    while ((terminated_pid = wait(&status)) > 0) {
-        if (terminated_pid == -1) {
-            fprintf(stderr, "Failed to wait for child process\n");
-            exit(EXIT_FAILURE);
-        }
-
-        if (WIFEXITED(status)) {
-            printf("Processo filho %d terminado com estado %d\n", terminated_pid, WEXITSTATUS(status));
-        }
-        else if (WIFSIGNALED(status)) {
-            printf("Processo filho %d terminado por signal %d\n", terminated_pid, WTERMSIG(status));
-        }
+  }
+  // Sem mais ficheiros, os workers leem EOF e terminam
+  close(jobs_pipe[1]);
+
+  // Espera a conclusão dos workers
+  int status = 0;
+  pid_t terminated_pid;
+  while ((terminated_pid = wait(&status)) > 0) {
+    if (WIFEXITED(status)) {
+      printf("Processo filho %d terminado com estado %d\n", terminated_pid, WEXITSTATUS(status));
+    }
+    else if (WIFSIGNALED(status)) {
+      printf("Processo filho %d terminado por signal %d\n", terminated_pid, WTERMSIG(status));
     }
   }
+
   if (closedir(dir) == -1) {
     fprintf(stderr, "Failed to close directory\n");
     return 1;
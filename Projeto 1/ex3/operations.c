@@ -1,5 +1,7 @@
 #include <pthread.h>
 #include <limits.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -7,39 +9,61 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <string.h>
 #include <dirent.h>
+#include <sys/uio.h>
 
 #include "eventlist.h"
 #include "operations.h"
 #include "parser.h"
 #include "constants.h"
+#include "queue.h"
 #include <sys/stat.h>
 
 
-#define MAX_SIZE 100000
+// Saída de SHOW e LIST: blocos de tamanho fixo escritos com writev
+#define OUTPUT_CHUNK_SIZE 4096
+#define OUTPUT_CHUNKS 16
+#define UINT_DIGITS 10  // dígitos de UINT_MAX
+
+/// WAIT pending for a thread: commands queued after the WAIT only start
+/// once the deadline has passed.
+/// @note There is one slot per thread instead of a timer wheel or heap: a
+/// thread only ever waits on its own deadline, later WAITs add to it, and
+/// the thread sleeps on it itself with no lock held. With no timer thread
+/// firing deadlines for others, there is nothing for a wheel to order.
+struct ThreadWait {
+  pthread_mutex_t lock;
+  int pending;               // se há um WAIT por cumprir
+  size_t after;              // posição na fila do primeiro WAIT por cumprir
+  struct timespec deadline;  // CLOCK_MONOTONIC
+};
 
 // Definir uma estrutura para os argumentos da thread
 struct ThreadArgs {
-    int fdRead;   // Descritor de arquivo de leitura
     int fdWrite;  // Descritor de arquivo de escrita
-    pthread_mutex_t *mutex;  // mutex para a leitura e gravação
+    struct CommandQueue *queue;  // comandos lidos pelo parser
     int id; // thread id (tid)
-    int *wait_flags; // array de flags para as threads esperarem
+    struct ThreadWait *waits; // WAITs por cumprir de cada thread, indexados pelo id
+    pthread_barrier_t *barrier; // onde as threads esperam umas pelas outras num BARRIER
     int num_threads; // número de threads
 };
 
+/// Output of a command, rendered in fixed-size chunks and written with writev.
+struct Output {
+  int fd;
+  int locked;    // se write_file_mutex já foi trancado
+  size_t chunk;  // bloco a ser preenchido
+  size_t len;    // bytes já usados nesse bloco
+  struct iovec iov[OUTPUT_CHUNKS];
+  char chunks[OUTPUT_CHUNKS][OUTPUT_CHUNK_SIZE];
+};
+
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_ms = 0;
 
 pthread_mutex_t write_file_mutex; // mutex para escrever no ficheiro
 pthread_mutex_t memory_mutex; // mutex para aceder à memória
 
-unsigned int wait_id = 0; // id da thread a esperar
-unsigned int wait_time = 0; // tempo de espera
-
-int foundBarrier = 0; // flag para barreira
-
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
 /// @return Timespec with the given delay.
@@ -64,7 +88,7 @@ static struct Event* get_event_with_delay(unsigned int event_id) {
 /// @param event Event to get the seat from.
 /// @param index Index of the seat to get.
 /// @return Pointer to the seat.
-static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
+static _Atomic unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
@@ -79,6 +103,46 @@ static unsigned int* get_seat_with_delay(struct Event* event, size_t index) {
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
+/// Waits a little before checking again, yielding first and then sleeping.
+static void backoff(unsigned int* spins) {
+  if ((*spins)++ < 64) {
+    sched_yield();
+    return;
+  }
+  struct timespec pause = {0, 100000};
+  nanosleep(&pause, NULL);
+}
+
+/// Marks the start of a reservation changing the seats of an event, waiting
+/// while a SHOW is reading them.
+static void seats_write_begin(struct Event* event) {
+  unsigned int spins = 0;
+  while (1) {
+    while (atomic_load(&event->gate) != 0) {
+      backoff(&spins);
+    }
+    atomic_fetch_add(&event->started, 1);
+    // Um SHOW pode ter fechado a porta entretanto: desiste sem tocar nos lugares
+    if (atomic_load(&event->gate) == 0) {
+      return;
+    }
+    atomic_fetch_add(&event->finished, 1);
+  }
+}
+
+/// Marks the end of a reservation changing the seats, kept or rolled back.
+static void seats_write_end(struct Event* event) { atomic_fetch_add(&event->finished, 1); }
+
+/// Checks that no reservation is changing the seats. finished is read first:
+/// if both are equal, they were equal at that moment.
+/// @param started Pointer to store the number of reservations started in.
+/// @return 1 if no reservation was in progress, 0 otherwise.
+static int seats_quiet(struct Event* event, unsigned int* started) {
+  unsigned int finished = atomic_load(&event->finished);
+  *started = atomic_load(&event->started);
+  return *started == finished;
+}
+
 int ems_init(unsigned int delay_ms) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
@@ -102,6 +166,15 @@ int ems_terminate() {
   return 0;
 }
 
+int ems_reset() {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  return reset_list(event_list);
+}
+
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
@@ -113,52 +186,30 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
-
-  if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
+  // O evento é criado e adicionado com o mutex, que também protege a arena
+  if (pthread_mutex_lock(&memory_mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
     return 1;
   }
-
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  event->data = malloc(num_rows * num_cols * sizeof(unsigned int));
-  event->mutexes = malloc(num_rows * num_cols * sizeof(pthread_mutex_t)); // mutex para cada lugar
-  if (pthread_mutex_init(&event->event_mutex, NULL) != 0) {
-    fprintf(stderr, "Error initializing mutex\n");
+  // Outra thread pode ter criado o evento entretanto
+  if (get_event(event_list, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    if (pthread_mutex_unlock(&memory_mutex) != 0) {
+      fprintf(stderr, "Error unlocking mutex\n");
+    }
     return 1;
   }
 
-  // Em caso de erro, liberta memória alocada
-  if (event->data == NULL || event->mutexes == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    free(event->data);
-    free(event->mutexes);
-    free(event);
-    return 1;
-  }
-  
-  // Inicializa mutex de todos os lugares
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i] = 0;
-    if (pthread_mutex_init(&event->mutexes[i],NULL) != 0) {
-      fprintf(stderr, "Error initializing mutex\n");
-      return 1;
+  struct Event* event = create_event(event_list, event_id, num_rows, num_cols);
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    if (pthread_mutex_unlock(&memory_mutex) != 0) {
+      fprintf(stderr, "Error unlocking mutex\n");
     }
-  }
-  
-  // Em caso de erro a juntar à lista de eventos, liberta memória alocada
-  if (pthread_mutex_lock(&memory_mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
     return 1;
   }
   if (append_to_list(event_list, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
-    free(event->mutexes);
-    free(event->data);
-    free(event);
     if (pthread_mutex_unlock(&memory_mutex) != 0) {
       fprintf(stderr, "Error unlocking mutex\n");
       return 1;
@@ -173,47 +224,104 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
   return 0;
 }
 
-int ems_free_event(unsigned int event_id) {
-  struct Event* event = get_event_with_delay(event_id);
 
-  if (event != NULL) {
-    free(event->data);
-    free(event);
+// Troca dois lugares nos vetores xs e ys
+#define SORT_INSERTION_THRESHOLD 32
+#define SORT_STACK_KEYS 256
+
+/// Packs a seat in a single key that orders by row and then by column.
+static uint64_t seat_key(size_t row, size_t col) { return ((uint64_t)row << 32) | (uint64_t)col; }
+
+static void insertion_sort(uint64_t* keys, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    uint64_t key = keys[i];
+    size_t j = i;
+    while (j > 0 && keys[j - 1] > key) {
+      keys[j] = keys[j - 1];
+      j--;
+    }
+    keys[j] = key;
   }
-
-  return 0;
 }
 
-// Troca dois lugares nos vetores xs e ys
-void switch_seats(size_t* xs, size_t* ys, size_t i, size_t j) {
-    size_t temp = xs[i];
-    xs[i] = xs[j];
-    xs[j] = temp;
-
-    temp = ys[i];
-    ys[i] = ys[j];
-    ys[j] = temp;
+/// LSD radix sort, one byte per pass. Passes where every key has the same
+/// byte are skipped, so small coordinates only cost a few passes.
+static void radix_sort(uint64_t* keys, uint64_t* tmp, size_t n) {
+  uint64_t* from = keys;
+  uint64_t* to = tmp;
+  for (unsigned int shift = 0; shift < 64; shift += 8) {
+    size_t count[256] = {0};
+    for (size_t i = 0; i < n; i++) {
+      count[(from[i] >> shift) & 0xFF]++;
+    }
+    if (count[(from[0] >> shift) & 0xFF] == n) {
+      continue;
+    }
+
+    size_t pos = 0;
+    for (size_t b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = pos;
+      pos += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      to[count[(from[i] >> shift) & 0xFF]++] = from[i];
+    }
+
+    uint64_t* swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != keys) {
+    memcpy(keys, from, n * sizeof(uint64_t));
+  }
 }
 
-// Ordena lugares utilizando um algoritmo bubblesort
+// Ordena os lugares por (linha, coluna), o que dá a ordem de reserva, e
+// rejeita lugares repetidos
 int sort_seats(size_t num_seats, size_t* xs, size_t* ys) {
-    // Algoritmo de ordenação
-    for (size_t i = 0; i < num_seats - 1; i++) {
-        for (size_t j = 0; j < num_seats - i - 1; j++) {
-            // Ordena por linhas
-            if (xs[j] > xs[j + 1]) {
-                switch_seats(xs, ys, j, j + 1);
-            }
-            // Se as linhas forem iguais, ordena por colunas
-            else if (xs[j] == xs[j + 1] && ys[j] == ys[j + 1]) {
-              return 1;
-            }
-            else if (xs[j] == xs[j + 1] && ys[j] > ys[j + 1]) {
-                switch_seats(xs, ys, j, j + 1);
-            }
-        }
-    }
+  if (num_seats == 0) {
     return 0;
+  }
+
+  uint64_t stack_keys[2 * SORT_STACK_KEYS];
+  uint64_t* keys = stack_keys;
+  if (num_seats > SORT_STACK_KEYS) {
+    keys = malloc(2 * num_seats * sizeof(uint64_t));
+    if (keys == NULL) {
+      fprintf(stderr, "Error allocating memory\n");
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] > UINT32_MAX || ys[i] > UINT32_MAX) {
+      fprintf(stderr, "Invalid seat\n");
+      if (keys != stack_keys) free(keys);
+      return 1;
+    }
+    keys[i] = seat_key(xs[i], ys[i]);
+  }
+
+  if (num_seats <= SORT_INSERTION_THRESHOLD) {
+    insertion_sort(keys, num_seats);
+  } else {
+    radix_sort(keys, keys + num_seats, num_seats);
+  }
+
+  // Depois de ordenados, lugares repetidos ficam lado a lado
+  int result = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (i > 0 && keys[i] == keys[i - 1]) {
+      result = 1;
+      break;
+    }
+    xs[i] = (size_t)(keys[i] >> 32);
+    ys[i] = (size_t)(keys[i] & UINT32_MAX);
+  }
+
+  if (keys != stack_keys) free(keys);
+  return result;
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
@@ -222,15 +330,7 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     return 1;
   }
 
-  if (pthread_mutex_lock(&memory_mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return 1;
-  } 
   struct Event* event = get_event_with_delay(event_id);
-  if (pthread_mutex_unlock(&memory_mutex) != 0) {
-    fprintf(stderr, "Error unlocking mutex\n");
-    return 1;
-  }
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
@@ -241,167 +341,252 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
   if(sort_seats(num_seats, xs, ys)) {
     return 1;
   } 
-  
-  // Bloqueia os mutexes dos lugares a reservar
-  for (size_t a = 0; a < num_seats; a++) {
-    if (pthread_mutex_lock(&event->mutexes[seat_index(event, xs[a], ys[a])]) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      return 1;
     }
   }
 
-  // Verifica se os lugares estão disponíveis
+  // Marca os lugares como ocupados por ordem, com compare-and-swap
+  seats_write_begin(event);
   size_t i = 0;
   for (; i < num_seats; i++) {
-    size_t row = xs[i];
-    size_t col = ys[i];
-
-    if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
-      fprintf(stderr, "Invalid seat\n");
-      break;
-    }
-    if (*get_seat_with_delay(event, seat_index(event, row, col)) != 0) {
+    unsigned int expected = 0;
+    _Atomic unsigned int* seat = get_seat_with_delay(event, seat_index(event, xs[i], ys[i]));
+    if (!atomic_compare_exchange_strong(seat, &expected, SEAT_CLAIMED)) {
       fprintf(stderr, "Seat already reserved\n");
       break;
     }
   }
 
-  // Se os lugares estiverem disponíveis, reserva-os
-  if(i == num_seats) {
-    if (pthread_mutex_lock(&event->event_mutex) != 0) {
+  // Se a reserva falhar, liberta os lugares já marcados
+  if (i < num_seats) {
+    while (i > 0) {
+      i--;
+      atomic_store(&event->data[seat_index(event, xs[i], ys[i])], 0);
+    }
+    seats_write_end(event);
+    return 1;
+  }
+
+  // Todos os lugares estão marcados, atribui o id da reserva
+  unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+  for (i = 0; i < num_seats; i++) {
+    atomic_store(get_seat_with_delay(event, seat_index(event, xs[i], ys[i])), reservation_id);
+  }
+  seats_write_end(event);
+  return 0;
+}
+
+/// Pairs of decimal digits, from "00" to "99".
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// Writes the decimal representation of value, without a terminator.
+/// @param out Buffer with at least UINT_DIGITS bytes.
+/// @return The number of digits written.
+static size_t format_uint(char* out, unsigned int value) {
+  char digits[UINT_DIGITS];
+  char* p = digits + UINT_DIGITS;
+
+  // Dois dígitos por divisão, escritos do fim para o início
+  while (value >= 100) {
+    unsigned int pair = value % 100;
+    value /= 100;
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * pair, 2);
+  }
+  if (value >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * value, 2);
+  } else {
+    *--p = (char) ('0' + value);
+  }
+
+  size_t len = (size_t) (digits + UINT_DIGITS - p);
+  memcpy(out, p, len);
+  return len;
+}
+
+static void output_init(struct Output* out, int fd) {
+  out->fd = fd;
+  out->locked = 0;
+  out->chunk = 0;
+  out->len = 0;
+  for (size_t i = 0; i < OUTPUT_CHUNKS; i++) {
+    out->iov[i].iov_base = out->chunks[i];
+    out->iov[i].iov_len = 0;
+  }
+}
+
+/// Writes every filled chunk with writev, taking write_file_mutex the first
+/// time so that the whole output of a command stays contiguous in the file.
+/// @return 0 if the chunks were written, 1 otherwise.
+static int output_flush(struct Output* out) {
+  if (!out->locked) {
+    if (pthread_mutex_lock(&write_file_mutex) != 0) {
       fprintf(stderr, "Error locking mutex\n");
       return 1;
     }
-    unsigned int reservation_id = ++event->reservations;
-    if (pthread_mutex_unlock(&event->event_mutex) != 0) {
-      fprintf(stderr, "Error unlocking mutex\n");
+    out->locked = 1;
+  }
+
+  out->iov[out->chunk].iov_len = out->len;
+  int first = 0;
+  int count = (int) out->chunk + (out->len > 0 ? 1 : 0);
+  while (first < count) {
+    ssize_t bytes_written = writev(out->fd, out->iov + first, count - first);
+
+    if (bytes_written < 0) {
+      fprintf(stderr, "Failed to write in file: %s\n", strerror(errno));
       return 1;
     }
-    for ( i = 0; i < num_seats; i++) {
-      size_t row = xs[i];
-      size_t col = ys[i];
-      
-      *get_seat_with_delay(event, seat_index(event, row, col)) = reservation_id;
-      
-    }
-  }
 
-  // Se a reserva falhar, desbloqueia os mutexes dos lugares
-  else if (i < num_seats) {
-    for (size_t k = 0; k < num_seats; k++) {
-      if (pthread_mutex_unlock(&event->mutexes[seat_index(event, xs[k], ys[k])]) != 0) {
-        fprintf(stderr, "Error unlocking mutex\n");
-        return 1;
-      }
+    // Pode não ter conseguido escrever tudo, avança para o que falta
+    size_t done = (size_t) bytes_written;
+    while (first < count && done >= out->iov[first].iov_len) {
+      done -= out->iov[first].iov_len;
+      first++;
     }
-    return 1;
-  }
-  
-  for (size_t k = 0; k < num_seats; k++) {
-    if (pthread_mutex_unlock(&event->mutexes[seat_index(event, xs[k], ys[k])]) != 0) {
-      fprintf(stderr, "Error unlocking mutex\n");
-      return 1;
+    if (first < count) {
+      out->iov[first].iov_base = (char*) out->iov[first].iov_base + done;
+      out->iov[first].iov_len -= done;
     }
   }
+
+  for (size_t i = 0; i < OUTPUT_CHUNKS; i++) {
+    out->iov[i].iov_base = out->chunks[i];
+    out->iov[i].iov_len = 0;
+  }
+  out->chunk = 0;
+  out->len = 0;
   return 0;
 }
 
-int ems_show(int fd, unsigned int event_id) {
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
-    return 1;
+/// Returns a pointer to at least size free bytes in the current chunk,
+/// moving to the next chunk or flushing them all when it is full.
+/// @return The pointer, or NULL if the chunks could not be flushed.
+static char* output_reserve(struct Output* out, size_t size) {
+  if (OUTPUT_CHUNK_SIZE - out->len < size) {
+    if (out->chunk + 1 == OUTPUT_CHUNKS) {
+      if (output_flush(out) != 0) {
+        return NULL;
+      }
+    } else {
+      out->iov[out->chunk].iov_len = out->len;
+      out->chunk++;
+      out->len = 0;
+    }
   }
+  return out->chunks[out->chunk] + out->len;
+}
 
-  if (pthread_mutex_lock(&memory_mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return 1;
-  } 
-  struct Event* event = get_event_with_delay(event_id);
-  if (pthread_mutex_unlock(&memory_mutex) != 0) {
-    fprintf(stderr, "Error unlocking mutex\n");
-    return 1;
+/// Writes what is left in the chunks and releases write_file_mutex.
+/// @param status 0 to write the chunks, anything else to only release the mutex.
+/// @return 0 if the output was written, 1 if it failed before, -1 if writing failed.
+static int output_finish(struct Output* out, int status) {
+  if (status == 0 && output_flush(out) != 0) {
+    status = -1;
   }
-
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
+  if (out->locked && pthread_mutex_unlock(&write_file_mutex) != 0) {
+    fprintf(stderr, "Error unlocking mutex\n");
     return 1;
   }
+  return status;
+}
 
-  // Escreve os lugares num buffer
-  char buffer[MAX_SIZE];
-  int bytes_written = 0;
-  int offset = 0;
+/// Checks that the output of a SHOW of an event fits in the chunks, so that
+/// rendering it never writes to the file. Each chunk holds at least
+/// OUTPUT_CHUNK_SIZE / (UINT_DIGITS + 1) seats, each with its separator.
+static int show_fits_chunks(struct Event* event) {
+  size_t capacity = OUTPUT_CHUNKS * (OUTPUT_CHUNK_SIZE / (UINT_DIGITS + 1));
+  // Uma linha sem colunas ocupa só o fim de linha
+  size_t per_row = event->cols > 0 ? event->cols : 1;
+  return event->rows == 0 || per_row <= capacity / event->rows;
+}
 
-  // Bloqueia os mutexes dos lugares a mostrar
+/// Renders the seats of an event, read straight from the event, one row per line.
+/// @return 0 if the seats were rendered, 1 if writing a full set of chunks failed.
+static int render_seats(struct Event* event, struct Output* out) {
   for (size_t i = 1; i <= event->rows; i++) {
     for (size_t j = 1; j <= event->cols; j++) {
-      if (pthread_mutex_lock(&event->mutexes[seat_index(event,i,j)]) != 0) {
-        fprintf(stderr, "Error locking mutex\n");
-        return 1;
-      }
-      unsigned int* seat = get_seat_with_delay(event, seat_index(event, i, j));
-      bytes_written = ((int) snprintf(buffer + offset, (unsigned long) (MAX_SIZE - offset), "%u", *seat));
-
-      if (bytes_written < 0 || bytes_written >= MAX_SIZE - offset) {
-        fprintf(stderr, "Failed to write in buffer\n");
-        for (size_t a = 1; a <= i; a++) {
-          for(size_t b = 1; b <= j; b++) {
-            if (pthread_mutex_unlock(&event->mutexes[seat_index(event,a,b)]) != 0) {
-              fprintf(stderr, "Error unlocking mutex\n");
-              return 1;
-            }
-          }
-        }
-        return 1;
-      }
-      offset += bytes_written;
+      unsigned int seat = atomic_load(get_seat_with_delay(event, seat_index(event, i, j)));
 
-      if (j < event->cols) {
-        offset = writeStringToBuffer(buffer, offset, " ");
+      // Os dígitos e o separador, espaço ou fim de linha
+      char* p = output_reserve(out, UINT_DIGITS + 1);
+      if (p == NULL) {
+        return 1;
       }
-     
+      size_t len = format_uint(p, seat);
+      p[len++] = j < event->cols ? ' ' : '\n';
+      out->len += len;
     }
-    offset = writeStringToBuffer(buffer, offset, "\n");
-  }
-
-  // Desbloqueia os mutexes dos lugares
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      if (pthread_mutex_unlock(&event->mutexes[seat_index(event,i,j)]) != 0) {
-        fprintf(stderr, "Error unlocking mutex\n");
+    if (event->cols == 0) {
+      char* p = output_reserve(out, 1);
+      if (p == NULL) {
         return 1;
       }
+      *p = '\n';
+      out->len++;
     }
   }
+  return 0;
+}
 
-  // Escreve do buffer para o ficheiro utilizando o seu file descriptor
-  if (pthread_mutex_lock(&write_file_mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+int ems_show(int fd, unsigned int event_id) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
-  size_t len = (size_t) strlen(buffer);
-  int done = 0;
-  while (len > 0) {
-    bytes_written = (int) write(fd, buffer + done, len);
 
-    if (bytes_written < 0){
-        fprintf(stderr, "Failed to write in file: %s\n", strerror(errno));
-        if (pthread_mutex_unlock(&write_file_mutex) != 0) {
-          fprintf(stderr, "Error unlocking mutex\n");
-          return 1;
-        }
-        return -1;
-    }
+  struct Event* event = get_event_with_delay(event_id);
 
-    // Pode não ter conseguido escrever tudo, len torna-se o que falta
-    len -= (size_t) bytes_written;
-    done += bytes_written;
-  }
-  if (pthread_mutex_unlock(&write_file_mutex) != 0) {
-    fprintf(stderr, "Error unlocking mutex\n");
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  return 0;
+  // Os lugares são lidos entre duas reservas, para nunca mostrar metade de
+  // uma, e escritos diretamente nos blocos, sem copiar o evento
+  struct Output out;
+  if (show_fits_chunks(event)) {
+    // Sem escrever no ficheiro, uma tentativa falhada só recomeça os blocos
+    for (int try = 0; try < SHOW_OPTIMISTIC_TRIES; try++) {
+      unsigned int before;
+      if (!seats_quiet(event, &before)) {
+        continue;
+      }
+      output_init(&out, fd);
+      render_seats(event, &out);
+      // Qualquer reserva que começou durante a leitura aumentou started
+      if (atomic_load(&event->started) == before) {
+        return output_finish(&out, 0);
+      }
+    }
+  }
+
+  // As reservas novas deste evento esperam até a saída estar escrita
+  atomic_fetch_add(&event->gate, 1);
+  unsigned int spins = 0;
+  unsigned int started;
+  while (!seats_quiet(event, &started)) {
+    backoff(&spins);
+  }
+  output_init(&out, fd);
+  int status = render_seats(event, &out) != 0 ? -1 : 0;
+  atomic_fetch_sub(&event->gate, 1);
+  return output_finish(&out, status);
 }
 
 int ems_list_events(int fd) {
@@ -410,302 +595,330 @@ int ems_list_events(int fd) {
     return 1;
   }
 
-  char buffer[MAX_SIZE];
-  int bytes_written = 0;
-  int offset = 0;
+  static const char no_events[] = "No events\n";
+  static const char event_prefix[] = "Event: ";
 
+  struct Output out;
+  output_init(&out, fd);
 
-  // Escreve a informação num buffer
   if (pthread_mutex_lock(&memory_mutex) != 0) {
     fprintf(stderr, "Error locking mutex\n");
     return 1;
-  } 
+  }
+  int status = 0;
   if (event_list->head == NULL) {
-    offset = writeStringToBuffer(buffer, offset, "No events\n");
+    // O primeiro bloco está vazio, por isso não é preciso escrever nada ainda
+    char* p = output_reserve(&out, sizeof(no_events) - 1);
+    memcpy(p, no_events, sizeof(no_events) - 1);
+    out.len += sizeof(no_events) - 1;
   }
 
   struct ListNode* current = event_list->head;
   while (current != NULL) {
-    bytes_written = ((int) snprintf(buffer + offset, (unsigned long) (MAX_SIZE - offset), "Event: %u\n", (current->event)->id));
-
-    if (bytes_written < 0 || bytes_written >= MAX_SIZE - offset) {
-      fprintf(stderr, "Failed to write in buffer\n");
-      if (pthread_mutex_unlock(&memory_mutex) != 0) {
-        fprintf(stderr, "Error unlocking mutex\n");
-        return 1;
-      } 
-      return -1;
+    char* p = output_reserve(&out, sizeof(event_prefix) - 1 + UINT_DIGITS + 1);
+    if (p == NULL) {
+      status = -1;
+      break;
     }
-    offset += bytes_written;
+    memcpy(p, event_prefix, sizeof(event_prefix) - 1);
+    size_t len = sizeof(event_prefix) - 1;
+    len += format_uint(p + len, (current->event)->id);
+    p[len++] = '\n';
+    out.len += len;
     current = current->next;
   }
   if (pthread_mutex_unlock(&memory_mutex) != 0) {
     fprintf(stderr, "Error unlocking mutex\n");
+    output_finish(&out, 1);
     return 1;
   }
 
-  // Escreve do buffer para o ficheiro utilizando o seu file descriptor
-  if (pthread_mutex_lock(&write_file_mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return 1;
-  }
-  size_t len = (size_t) strlen(buffer);
-  int done = 0;
-  while (len > 0) {
-    bytes_written = (int) write(fd, buffer + done, len);
+  return output_finish(&out, status);
+}
 
-    if (bytes_written < 0){
-        fprintf(stderr, "Failed to write in file: %s\n", strerror(errno));
-        if (pthread_mutex_unlock(&write_file_mutex) != 0) {
-          fprintf(stderr, "Error unlocking mutex\n");
-          return 1;
-        }
-        return -1;
-    }
+void ems_wait(unsigned int delay_ms) {
+  struct timespec delay = delay_to_timespec(delay_ms);
+  nanosleep(&delay, NULL);
+}
 
-    // Pode não ter conseguido escrever tudo, len torna-se o que falta
-    len -= (size_t) bytes_written;
-    done += bytes_written;
+static int timespec_before(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/// Schedules a WAIT for a thread, from now on. WAITs scheduled before the
+/// thread honors the previous one add up, as if executed one after another.
+/// @param wait Wait state of the target thread.
+/// @param pos Position of the WAIT command in the queue.
+/// @param delay_ms Delay in milliseconds.
+static void wait_schedule(struct ThreadWait *wait, size_t pos, unsigned int delay_ms) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&wait->lock);
+  if (!wait->pending) {
+    wait->pending = 1;
+    wait->after = pos;
+    wait->deadline = now;
   }
-  if (pthread_mutex_unlock(&write_file_mutex) != 0) {
-    fprintf(stderr, "Error unlocking mutex\n");
-    return 1;
+  else if (timespec_before(&wait->deadline, &now)) {
+    wait->deadline = now;
   }
 
-  return 0;
-}
-
-void ems_wait(unsigned int delay_ms) {
   struct timespec delay = delay_to_timespec(delay_ms);
-  nanosleep(&delay, NULL);
+  wait->deadline.tv_sec += delay.tv_sec;
+  wait->deadline.tv_nsec += delay.tv_nsec;
+  if (wait->deadline.tv_nsec >= 1000000000L) {
+    wait->deadline.tv_sec++;
+    wait->deadline.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_unlock(&wait->lock);
 }
 
-int writeStringToBuffer(char* buffer, int offset, const char* inputString) {
-    int bytes_written = ((int) snprintf(buffer + offset, (unsigned long) (MAX_SIZE - offset), "%s", inputString));
+/// Sleeps until the deadline of the pending WAIT of a thread, if the command
+/// it is about to execute was queued after that WAIT. No other lock is held.
+/// @param wait Wait state of the calling thread.
+/// @param pos Position in the queue of the command about to be executed.
+static void wait_until_due(struct ThreadWait *wait, size_t pos) {
+  pthread_mutex_lock(&wait->lock);
+  int due = wait->pending && pos > wait->after;
+  struct timespec deadline = wait->deadline;
+  if (due) {
+    wait->pending = 0;
+  }
+  pthread_mutex_unlock(&wait->lock);
 
-    if (bytes_written < 0 || bytes_written >= MAX_SIZE - offset) {
-        fprintf(stderr, "Falha ao escrever na memória do buffer\n");
-        return -1;
-    }
+  if (!due) {
+    return;
+  }
+  printf("Waiting...\n");
 
-    return offset + bytes_written; // Retorna o novo offset
+  // Mesmo com um prazo já passado, clock_nanosleep dorme a folga do timer
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!timespec_before(&now, &deadline)) {
+    return;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    ;
 }
 
 // Função da thread
 void* execute_commands(void *args) {
   struct ThreadArgs *threadArgs = (struct ThreadArgs *)args;
-  int fdRead = threadArgs->fdRead;
   int fdWrite = threadArgs->fdWrite;
-  pthread_mutex_t *mutex_t = threadArgs->mutex;
   int thread_id = threadArgs->id;
+  struct ParsedCommand cmd;
 
-  unsigned int event_id;
-  size_t num_rows, num_columns, num_coords;
-  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  while (1) {
+    size_t pos = queue_pop(threadArgs->queue, &cmd);
 
-  int flag = 1;
-  while (flag == 1) {
-    // Bloqueia o mutex para a leitura e escrita
-    if (pthread_mutex_lock(mutex_t) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
-      return (void*) 1;
-    }
-    
-    // Verifica se a flag de barreira está ativa
-    if(foundBarrier == 1) {
-      if (pthread_mutex_unlock(mutex_t) != 0) {
-        fprintf(stderr, "Error unlocking mutex\n");
-        return (void*) 1;
-      }
-      return (void*)1;
-    }
-    // Espera se a flag de espera estiver ativa
-    if(threadArgs->wait_flags[thread_id]) {
-      printf("Waiting...\n");
-      ems_wait(wait_time);
-      threadArgs->wait_flags[thread_id] = 0;
+    // Espera se um WAIT anterior a este comando se aplicar a esta thread. A
+    // verificação é feita depois de tirar o comando, para não falhar um WAIT
+    // tirado por outra thread enquanto esta esperava pela fila. Um WAIT só
+    // regista prazos, não pode ficar atrasado por outro
+    if (cmd.type != CMD_WAIT) {
+      wait_until_due(&threadArgs->waits[thread_id], pos);
     }
 
-    // Lê o comando
-    switch (get_next(fdRead)) {
+    switch (cmd.type) {
         case CMD_CREATE:
-          if (parse_create(fdRead, &event_id, &num_rows, &num_columns) != 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            if (pthread_mutex_unlock(mutex_t) != 0) {
-              fprintf(stderr, "Error unlocking mutex\n");
-              return (void*) 1;
-            }
-            continue;
-          }
-
-          if (ems_create(event_id, num_rows, num_columns)) {
+          if (ems_create(cmd.event_id, cmd.num_rows, cmd.num_cols)) {
             fprintf(stderr, "Failed to create event\n");
           }
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-
           break;
 
         case CMD_RESERVE:
-          num_coords = parse_reserve(fdRead, MAX_RESERVATION_SIZE, &event_id, xs, ys);
-
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-
-          if (num_coords == 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
-          }
-
-          if (ems_reserve(event_id, num_coords, xs, ys)) {
+          if (ems_reserve(cmd.event_id, cmd.num_coords, cmd.xs, cmd.ys)) {
             fprintf(stderr, "Failed to reserve seats\n");
           }
-          
+          free(cmd.xs);
           break;
 
         case CMD_SHOW:
-          if (parse_show(fdRead, &event_id) != 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            if (pthread_mutex_lock(&memory_mutex) != 0) {
-              fprintf(stderr, "Error locking mutex\n");
-              return (void*) 1;
-            } 
-            continue;
-          }
-
-          if (ems_show(fdWrite, event_id)) {
+          if (ems_show(fdWrite, cmd.event_id)) {
             fprintf(stderr, "Failed to show event\n");
           }
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-          
           break;
 
         case CMD_LIST_EVENTS:
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-
           if (ems_list_events(fdWrite)) {
             fprintf(stderr, "Failed to list events\n");
           }
-          
           break;
 
         case CMD_WAIT:
-          if (parse_wait(fdRead, &wait_time, &wait_id) == -1) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            if (pthread_mutex_unlock(mutex_t) != 0) {
-              fprintf(stderr, "Error unlocking mutex\n");
-              return (void*) 1;
-            }
-            continue;
-          }
-
-          if(wait_id == 0) {
-            for(int i = 1 ; i < threadArgs->num_threads ; i++ ) {
-              threadArgs->wait_flags[i] = 1;
+          // Aplica-se aos comandos seguintes a este na fila
+          if (cmd.thread_id == 0) {
+            for (int i = 1; i <= threadArgs->num_threads; i++) {
+              wait_schedule(&threadArgs->waits[i], pos, cmd.delay);
             }
           }
           else {
-            threadArgs->wait_flags[wait_id] = 1;
-          }
-
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
+            wait_schedule(&threadArgs->waits[cmd.thread_id], pos, cmd.delay);
           }
+          break;
 
+        case CMD_BARRIER:
+          // Cada thread tira um único BARRIER da fila, por isso quando todas
+          // chegam aqui já terminaram os comandos anteriores
+          pthread_barrier_wait(threadArgs->barrier);
           break;
 
-        case CMD_INVALID:
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
+        case EOC:
+          return (void*)0;
 
-          break;
-        
         case CMD_HELP:
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-          printf(
-          "Available commands:\n"
-          "  CREATE <event_id> <num_rows> <num_columns>\n"
-          "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-          "  SHOW <event_id>\n"
-          "  LIST\n"
-          "  WAIT <delay_ms> [thread_id]\n"  // thread_id is not implemented
-          "  BARRIER\n"                      // Not implemented
-          "  HELP\n");
-
+        case CMD_EMPTY:
+        case CMD_INVALID:
           break;
+    }
 
-        case CMD_BARRIER:
-          foundBarrier = 1;
+    if (cmd.sync) {
+      queue_complete(threadArgs->queue);
+    }
+  }
+}
 
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-          
-          return (void*)1;
+/// Reads every command of the file into the queue. BARRIER and the end of the
+/// file are queued once for each thread.
+/// @param fd File descriptor to read from.
+/// @param queue Queue the threads take the commands from.
+/// @param num_threads Number of threads executing the commands.
+static void parse_commands(int fd, struct CommandQueue *queue, int num_threads) {
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  int pending_sync = 0;
 
-        case CMD_EMPTY:
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
+  while (1) {
+    struct ParsedCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = get_next(fd);
 
-          break;
+    switch (cmd.type) {
+      case CMD_CREATE:
+        if (parse_create(fd, &cmd.event_id, &cmd.num_rows, &cmd.num_cols) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+        cmd.sync = 1;
+        break;
 
-        case EOC:
-          if (pthread_mutex_unlock(mutex_t) != 0) {
-            fprintf(stderr, "Error unlocking mutex\n");
-            return (void*) 1;
-          }
-          flag = 0;
-          break;
+      case CMD_RESERVE:
+        cmd.num_coords = parse_reserve(fd, MAX_RESERVATION_SIZE, &cmd.event_id, xs, ys);
+        if (cmd.num_coords == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+        cmd.xs = malloc(2 * cmd.num_coords * sizeof(size_t));
+        if (cmd.xs == NULL) {
+          fprintf(stderr, "Error allocating memory\n");
+          continue;
+        }
+        cmd.ys = cmd.xs + cmd.num_coords;
+        memcpy(cmd.xs, xs, cmd.num_coords * sizeof(size_t));
+        memcpy(cmd.ys, ys, cmd.num_coords * sizeof(size_t));
+        break;
+
+      case CMD_SHOW:
+        // Só lê, e já vê o evento entre duas reservas: não precisa de esperar
+        if (parse_show(fd, &cmd.event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+        break;
+
+      case CMD_LIST_EVENTS:
+        break;
+
+      case CMD_WAIT:
+        if (parse_wait(fd, &cmd.delay, &cmd.thread_id) == -1) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+        if (cmd.thread_id > (unsigned int) num_threads) {
+          fprintf(stderr, "Invalid thread id\n");
+          continue;
+        }
+        if (cmd.delay == 0) {
+          continue;
+        }
+        // Os prazos ficam registados antes de alguma thread tirar o comando seguinte
+        cmd.sync = 1;
+        break;
+
+      case CMD_INVALID:
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+
+      case CMD_HELP:
+        printf(
+        "Available commands:\n"
+        "  CREATE <event_id> <num_rows> <num_columns>\n"
+        "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+        "  SHOW <event_id>\n"
+        "  LIST\n"
+        "  WAIT <delay_ms> [thread_id]\n"
+        "  BARRIER\n"
+        "  HELP\n");
+        continue;
+
+      case CMD_EMPTY:
+        continue;
+
+      case CMD_BARRIER:
+      case EOC:
+        break;
+    }
+
+    // CREATE e WAIT terminam antes de qualquer comando seguinte começar,
+    // mas o parser já leu o próximo enquanto esperava
+    if (pending_sync) {
+      queue_wait_complete(queue);
     }
+
+    if (cmd.type == CMD_BARRIER || cmd.type == EOC) {
+      // O parser não espera pela barreira, continua a ler os comandos seguintes
+      for (int i = 0; i < num_threads; i++) {
+        queue_push(queue, &cmd);
+      }
+      pending_sync = 0;
+      if (cmd.type == EOC) {
+        return;
+      }
+      continue;
+    }
+
+    queue_push(queue, &cmd);
+    pending_sync = cmd.sync;
   }
-  return (void*)0;
 }
 
-int ems_execute_child(struct dirent *dp, char *dirpath, int MAX_THREADS) {
+int ems_execute_child(const char *name, char *dirpath, int MAX_THREADS) {
   int fdRead = 0;
   int fdWrite = 0;
 
-  int flag = 1;
-
-  int wait_flags[MAX_THREADS + 1];
+  struct ThreadWait waits[MAX_THREADS + 1];
 
   for(int i = 0; i <= MAX_THREADS; i++) {
-    wait_flags[i] = 0;
+    if (pthread_mutex_init(&waits[i].lock, NULL) != 0) {
+      fprintf(stderr, "Error initializing mutex\n");
+      return 1;
+    }
+    waits[i].pending = 0;
   }
 
   // Constrói o caminho completo dos ficheiros de entrada e saída
-  char filepathInput[strlen(dirpath) + strlen("/") + strlen(dp->d_name) + 1];
-  char filepathOutput[strlen(dirpath) + strlen("/") + strlen(dp->d_name)];
+  char filepathInput[strlen(dirpath) + strlen("/") + strlen(name) + 1];
+  char filepathOutput[strlen(dirpath) + strlen("/") + strlen(name)];
 
   // Ficheiro de Input
   strcpy(filepathInput, dirpath);
   strcat(filepathInput, "/");
-  strcat(filepathInput, dp->d_name);
+  strcat(filepathInput, name);
 
   // Manipulação de strings para criação do nome do ficheiro de output
-  size_t size = strlen(dp->d_name) - 5;
+  size_t size = strlen(name) - 5;
   char filename[size + 4 + 1];  // +4 para ".out", +1 para o caractere nulo
-  strncpy(filename, dp->d_name, size);
+  strncpy(filename, name, size);
   filename[size] = '\0';  // Adiciona o caractere nulo manualmente
   strcat(filename, ".out");
 
@@ -724,21 +937,16 @@ int ems_execute_child(struct dirent *dp, char *dirpath, int MAX_THREADS) {
   fdWrite = open(filepathOutput, O_CREAT | O_TRUNC | O_WRONLY , S_IRUSR | S_IWUSR);
   if (fdWrite < 0) {
     fprintf(stderr,"Failed to create output file\n");
+    close(fdRead);
     return 1;
   }
 
-  // Criar e configurar mutex para secção crítica
-  pthread_mutex_t mutex;
-
   // Criar e configurar threads
   pthread_t threads[MAX_THREADS];
   struct ThreadArgs threadArgs[MAX_THREADS];
+  struct CommandQueue queue;
 
   // Inicializa mutexes
-  if (pthread_mutex_init(&mutex, NULL) != 0) {
-    fprintf(stderr, "Error initializing mutex\n");
-    return 1;
-  }
   if (pthread_mutex_init(&write_file_mutex, NULL) != 0) {
     fprintf(stderr, "Error initializing mutex\n");
     return 1;
@@ -747,46 +955,63 @@ int ems_execute_child(struct dirent *dp, char *dirpath, int MAX_THREADS) {
     fprintf(stderr, "Error initializing mutex\n");
     return 1;
   }
-  
-  while (flag) {
-    foundBarrier = 0;
-
-    for (int i = 0; i < MAX_THREADS; ++i) {
-      threadArgs[i].fdRead = fdRead;
-      threadArgs[i].fdWrite = fdWrite;
-      threadArgs[i].mutex = &mutex;
-      threadArgs[i].wait_flags = wait_flags;
-      threadArgs[i].id = i + 1;
-      threadArgs[i].num_threads = MAX_THREADS;
-
-      // Criar thread
-      if (pthread_create(&threads[i], 0, execute_commands, (void *)&threadArgs[i]) != 0) {
-        fprintf(stderr, "Error creating thread\n");
-        return 1;
-      }
+  if (queue_init(&queue) != 0) {
+    return 1;
+  }
+
+  pthread_barrier_t barrier;
+  if (pthread_barrier_init(&barrier, NULL, (unsigned int) MAX_THREADS) != 0) {
+    fprintf(stderr, "Error initializing barrier\n");
+    return 1;
+  }
+
+  // As threads executam os comandos enquanto esta thread os lê do ficheiro
+  int created = 0;
+  for (int i = 0; i < MAX_THREADS; ++i) {
+    threadArgs[i].fdWrite = fdWrite;
+    threadArgs[i].queue = &queue;
+    threadArgs[i].waits = waits;
+    threadArgs[i].barrier = &barrier;
+    threadArgs[i].id = i + 1;
+    threadArgs[i].num_threads = MAX_THREADS;
+
+    // Criar thread
+    if (pthread_create(&threads[i], 0, execute_commands, (void *)&threadArgs[i]) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      break;
     }
+    created++;
+  }
 
-    // Aguardar a conclusão de todas as threads
-    flag = 0;
-    for (int i = 0; i < MAX_THREADS; ++i) {
-      void *retorno;
-      if (pthread_join(threads[i], &retorno) != 0) {
-        fprintf(stderr, "Error joining thread\n");
-        return 1;
-      }
-      
-      if (retorno == (void*) 1) {
-        flag = 1;
-      }
+  if (created < MAX_THREADS) {
+    // Termina as threads já criadas antes de desistir
+    struct ParsedCommand stop = {.type = EOC};
+    for (int i = 0; i < created; i++) {
+      queue_push(&queue, &stop);
     }
   }
+  else {
+    parse_commands(fdRead, &queue, MAX_THREADS);
+  }
 
-  // Destrói mutexes
-  if (pthread_mutex_destroy(&write_file_mutex) != 0) {
-    fprintf(stderr, "Error destroying mutex\n");
+  // Aguardar a conclusão de todas as threads
+  for (int i = 0; i < created; ++i) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error joining thread\n");
+      return 1;
+    }
+  }
+  pthread_barrier_destroy(&barrier);
+  for (int i = 0; i <= MAX_THREADS; i++) {
+    pthread_mutex_destroy(&waits[i].lock);
+  }
+  if (created < MAX_THREADS) {
     return 1;
   }
-  if (pthread_mutex_destroy(&mutex) != 0) {
+
+  // Destrói mutexes
+  queue_destroy(&queue);
+  if (pthread_mutex_destroy(&write_file_mutex) != 0) {
     fprintf(stderr, "Error destroying mutex\n");
     return 1;
   }
@@ -795,8 +1020,6 @@ int ems_execute_child(struct dirent *dp, char *dirpath, int MAX_THREADS) {
     return 1;
   }
 
-  ems_terminate();
-
   // Fecha os ficheiros
   if (close(fdRead) == -1) {
     fprintf(stderr,"Failed to close file\n");
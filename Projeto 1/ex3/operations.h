@@ -11,6 +11,10 @@ int ems_init(unsigned int delay_ms);
 /// Destroys the EMS state.
 int ems_terminate();
 
+/// Frees every event, leaving the EMS state as it was right after ems_init.
+/// @return 0 if the EMS state was reset successfully, 1 otherwise.
+int ems_reset();
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
@@ -18,8 +22,6 @@ int ems_terminate();
 /// @return 0 if the event was created successfully, 1 otherwise.
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
-int ems_free_event(unsigned int event_id);
-
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
@@ -42,19 +44,17 @@ int ems_list_events(int fd);
 /// @param delay_us Delay in milliseconds.
 void ems_wait(unsigned int delay_ms);
 
-/// Prints the given string to the given file descriptor.
-int writeStringToBuffer(char* buffer, int offset, const char* inputString);
-
-/// Executes the child process
-int ems_execute_child(struct dirent *dp, char *dirpath, int MAX_THREADS);
+/// Executes the commands of a .jobs file, writing the results to the matching .out file.
+/// @note Events created by the file are kept until ems_reset is called.
+/// @param name Name of the .jobs file inside dirpath.
+/// @return 0 if the file was executed successfully, 1 otherwise.
+int ems_execute_child(const char *name, char *dirpath, int MAX_THREADS);
 
 /// Executes the commands
 void *execute_commands(void *args);
 
-/// Switches the seats at the given indices.
-void switch_seats(size_t* xs, size_t* ys, size_t i, size_t j);
-
-/// Sorts the seats at the given indices.
+/// Sorts the seats by row and then by column.
+/// @return 0 if the seats were sorted, 1 if a seat is repeated or invalid.
 int sort_seats(size_t num_seats, size_t* xs, size_t* ys);
 
 #endif  // EMS_OPERATIONS_H
\ No newline at end of file
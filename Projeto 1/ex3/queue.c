@@ -0,0 +1,64 @@
+#include "queue.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+
+static void sem_wait_intr(sem_t *sem) {
+  while (sem_wait(sem) == -1 && errno == EINTR)
+    ;
+}
+
+int queue_init(struct CommandQueue *queue) {
+  for (size_t i = 0; i < QUEUE_CAPACITY; i++) {
+    atomic_init(&queue->seq[i], i);
+  }
+  atomic_init(&queue->head, 0);
+  queue->tail = 0;
+
+  if (sem_init(&queue->items, 0, 0) != 0 || sem_init(&queue->free_slots, 0, QUEUE_CAPACITY) != 0 ||
+      sem_init(&queue->done, 0, 0) != 0) {
+    fprintf(stderr, "Error initializing semaphore\n");
+    return 1;
+  }
+  return 0;
+}
+
+void queue_destroy(struct CommandQueue *queue) {
+  sem_destroy(&queue->items);
+  sem_destroy(&queue->free_slots);
+  sem_destroy(&queue->done);
+}
+
+void queue_push(struct CommandQueue *queue, const struct ParsedCommand *command) {
+  sem_wait_intr(&queue->free_slots);
+
+  // Há um slot livre, mas pode não ser este: a thread que ficou com a posição
+  // anterior deste slot pode ainda não o ter copiado
+  size_t slot = queue->tail & (QUEUE_CAPACITY - 1);
+  while (atomic_load_explicit(&queue->seq[slot], memory_order_acquire) != queue->tail) {
+    sched_yield();
+  }
+
+  queue->slots[slot] = *command;
+  queue->tail++;
+  sem_post(&queue->items);
+}
+
+size_t queue_pop(struct CommandQueue *queue, struct ParsedCommand *command) {
+  sem_wait_intr(&queue->items);
+
+  // Os comandos são publicados por ordem, por isso a posição obtida já está
+  // preenchida. acq_rel: pode ter sido outra thread a ver o sem_post dessa posição
+  size_t pos = atomic_fetch_add_explicit(&queue->head, 1, memory_order_acq_rel);
+  size_t slot = pos & (QUEUE_CAPACITY - 1);
+  *command = queue->slots[slot];
+
+  atomic_store_explicit(&queue->seq[slot], pos + QUEUE_CAPACITY, memory_order_release);
+  sem_post(&queue->free_slots);
+  return pos;
+}
+
+void queue_complete(struct CommandQueue *queue) { sem_post(&queue->done); }
+
+void queue_wait_complete(struct CommandQueue *queue) { sem_wait_intr(&queue->done); }
@@ -0,0 +1,60 @@
+#ifndef EMS_QUEUE_H
+#define EMS_QUEUE_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "parser.h"
+
+#define QUEUE_CAPACITY 256  // Deve ser uma potência de 2
+
+/// Command read from a .jobs file, ready to be executed by a thread.
+struct ParsedCommand {
+  enum Command type;
+  unsigned int event_id;
+  size_t num_rows;         /// CREATE
+  size_t num_cols;         /// CREATE
+  size_t num_coords;       /// RESERVE
+  size_t *xs;              /// RESERVE, allocated with malloc together with ys
+  size_t *ys;              /// RESERVE
+  unsigned int delay;      /// WAIT
+  unsigned int thread_id;  /// WAIT, 0 for every thread
+  int sync;                /// The parser waits for it to complete before queueing more
+};
+
+/// Ring buffer of parsed commands, filled by a single parser thread and
+/// emptied by the executor threads.
+struct CommandQueue {
+  struct ParsedCommand slots[QUEUE_CAPACITY];
+  _Atomic size_t seq[QUEUE_CAPACITY];  // Próxima posição que pode usar cada slot
+  _Atomic size_t head;                 // Próxima posição a consumir
+  size_t tail;                         // Próxima posição a preencher, só usada pelo parser
+  sem_t items;                         // Comandos por consumir
+  sem_t free_slots;                    // Slots livres
+  sem_t done;                          // Comandos com sync terminados
+};
+
+/// Initializes an empty queue.
+/// @return 0 if the queue was initialized successfully, 1 otherwise.
+int queue_init(struct CommandQueue *queue);
+
+/// Frees the resources of the queue.
+void queue_destroy(struct CommandQueue *queue);
+
+/// Adds a command to the queue, blocking while it is full. Only called by the parser.
+void queue_push(struct CommandQueue *queue, const struct ParsedCommand *command);
+
+/// Removes the oldest command from the queue, blocking while it is empty.
+/// The position is claimed with an atomic increment of head, without a lock;
+/// the items semaphore only puts the executor to sleep when there is nothing to pop.
+/// @return Position of the command in the queue, counting from 0.
+size_t queue_pop(struct CommandQueue *queue, struct ParsedCommand *command);
+
+/// Signals the parser that a command with sync set has been executed.
+void queue_complete(struct CommandQueue *queue);
+
+/// Blocks until queue_complete is called for the last command with sync set.
+void queue_wait_complete(struct CommandQueue *queue);
+
+#endif  // EMS_QUEUE_H
@@ -0,0 +1,123 @@
+// Benchmark do BARRIER: gera um .jobs com RESERVE, LIST, SHOW e WAIT 0
+// separados por BARRIERs e mede quanto tempo ems_execute_child demora a
+// executá-lo com diferentes números de threads.
+// Uso: bench_barrier [número de BARRIERs] [threads...]
+// Sem threads indicadas, mede com 1, 4 e 16.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+#define JOBS_NAME "bench.jobs"
+#define OUT_NAME "bench.out"
+#define ROWS 10
+#define COLS 10
+#define SHOW_EVENT_ID 1
+
+/// Writes a .jobs file with num_barriers BARRIERs to dirpath.
+/// @return 0 if the file was written, 1 otherwise.
+static int generate(const char* dirpath, long num_barriers) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dirpath, JOBS_NAME);
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return 1;
+  }
+
+  // Cada lugar lido custa um nanosleep, mesmo sem atraso, por isso o SHOW é
+  // de um evento com um só lugar para não esconder o custo das barreiras
+  fprintf(file, "CREATE %d 1 1\n", SHOW_EVENT_ID);
+
+  // Eventos suficientes para cada RESERVE ter um lugar livre
+  long num_reserves = (num_barriers + 3) / 4;
+  long num_events = (num_reserves + ROWS * COLS - 1) / (ROWS * COLS);
+  for (long e = 1; e <= num_events; e++) {
+    fprintf(file, "CREATE %ld %d %d\n", SHOW_EVENT_ID + e, ROWS, COLS);
+  }
+
+  long reserves = 0;
+  for (long n = 0; n < num_barriers; n++) {
+    switch (n % 4) {
+      case 0:
+        fprintf(file, "RESERVE %ld [(%ld,%ld)]\n", SHOW_EVENT_ID + reserves / (ROWS * COLS) + 1,
+                reserves % (ROWS * COLS) / COLS + 1, reserves % COLS + 1);
+        reserves++;
+        break;
+      case 1:
+        fprintf(file, "LIST\n");
+        break;
+      case 2:
+        fprintf(file, "SHOW %d\n", SHOW_EVENT_ID);
+        break;
+      default:
+        fprintf(file, "WAIT 0\n");
+        break;
+    }
+    fprintf(file, "BARRIER\n");
+  }
+  return fclose(file) != 0;
+}
+
+/// Removes the files written by the benchmark and its directory.
+static void cleanup(char* dirpath) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dirpath, JOBS_NAME);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s", dirpath, OUT_NAME);
+  unlink(path);
+  rmdir(dirpath);
+}
+
+int main(int argc, char* argv[]) {
+  static const int default_threads[] = {1, 4, 16};
+  long num_barriers = argc > 1 ? atol(argv[1]) : 10000;
+  if (num_barriers <= 0) {
+    fprintf(stderr, "Usage: %s [barriers] [threads...]\n", argv[0]);
+    return 1;
+  }
+
+  char dirpath[] = "/tmp/bench_barrier_XXXXXX";
+  if (mkdtemp(dirpath) == NULL || generate(dirpath, num_barriers) != 0) {
+    fprintf(stderr, "Failed to generate the jobs file\n");
+    return 1;
+  }
+  if (ems_init(0) != 0) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    cleanup(dirpath);
+    return 1;
+  }
+
+  int num_runs = argc > 2 ? argc - 2 : 3;
+  int failed = 0;
+  printf("%ld barriers\nthreads        ms\n", num_barriers);
+  for (int i = 0; i < num_runs && !failed; i++) {
+    int threads = argc > 2 ? atoi(argv[i + 2]) : default_threads[i];
+    if (threads <= 0) {
+      fprintf(stderr, "Invalid number of threads: %s\n", argv[i + 2]);
+      failed = 1;
+      break;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    failed = ems_execute_child(JOBS_NAME, dirpath, threads) != 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    // Cada execução começa sem eventos
+    failed |= ems_reset() != 0;
+    if (failed) {
+      fprintf(stderr, "Failed to execute with %d threads\n", threads);
+      break;
+    }
+
+    double ms = (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("%7d  %8.1f\n", threads, ms);
+  }
+
+  ems_terminate();
+  cleanup(dirpath);
+  return failed;
+}
@@ -0,0 +1,132 @@
+// Benchmark do parser dos .jobs: gera um ficheiro com uma mistura de comandos
+// e mede quantos comandos por segundo get_next e parse_* conseguem ler.
+// Uso: bench_parser [MB do ficheiro gerado] [ficheiro .jobs já existente]
+// Para comparar com outra versão do parser, compilar este ficheiro com o
+// parser.c dessa versão (a API é a mesma).
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "parser.h"
+
+/// Writes about size_mb megabytes of commands to a temporary file.
+/// @return Path of the file, NULL on failure.
+static char* generate(size_t size_mb) {
+  static char path[] = "/tmp/bench_parser_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    return NULL;
+  }
+  FILE* file = fdopen(fd, "w");
+  if (file == NULL) {
+    close(fd);
+    return NULL;
+  }
+
+  unsigned int seed = 1;
+  size_t target = size_mb * 1024 * 1024;
+  long written = 0;
+  while ((size_t)written < target) {
+    unsigned int id = (unsigned int)rand_r(&seed) % 1000 + 1;
+    switch (rand_r(&seed) % 8) {
+      case 0:
+        written += fprintf(file, "CREATE %u %d %d\n", id, rand_r(&seed) % 100 + 1, rand_r(&seed) % 100 + 1);
+        break;
+      case 1:
+        written += fprintf(file, "SHOW %u\n", id);
+        break;
+      case 2:
+        written += fprintf(file, "LIST\n");
+        break;
+      case 3:
+        written += fprintf(file, "WAIT %d 1\n", rand_r(&seed) % 100);
+        break;
+      case 4:
+        written += fprintf(file, "# comentário %u\n", id);
+        break;
+      default:
+        written += fprintf(file, "RESERVE %u [", id);
+        for (int i = rand_r(&seed) % 8; i >= 0; i--) {
+          written += fprintf(file, "(%d,%d)%s", rand_r(&seed) % 100 + 1, rand_r(&seed) % 100 + 1, i > 0 ? " " : "");
+        }
+        written += fprintf(file, "]\n");
+        break;
+    }
+  }
+  if (fclose(file) != 0) {
+    unlink(path);
+    return NULL;
+  }
+  return path;
+}
+
+/// Parses every command of a file.
+/// @return Number of commands read.
+static size_t parse_all(int fd) {
+  static size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  unsigned int event_id, delay, thread_id;
+  size_t num_rows, num_cols;
+  size_t count = 0;
+
+  while (1) {
+    enum Command command = get_next(fd);
+    switch (command) {
+      case CMD_CREATE:
+        parse_create(fd, &event_id, &num_rows, &num_cols);
+        break;
+      case CMD_RESERVE:
+        parse_reserve(fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        break;
+      case CMD_SHOW:
+        parse_show(fd, &event_id);
+        break;
+      case CMD_WAIT:
+        parse_wait(fd, &delay, &thread_id);
+        break;
+      case CMD_LIST_EVENTS:
+      case CMD_BARRIER:
+      case CMD_HELP:
+      case CMD_EMPTY:
+      case CMD_INVALID:
+        break;
+      case EOC:
+        return count;
+    }
+    count++;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  size_t size_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+  char* path = argc > 2 ? argv[2] : generate(size_mb);
+  if (path == NULL) {
+    fprintf(stderr, "Failed to generate the jobs file\n");
+    return 1;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return 1;
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+  lseek(fd, 0, SEEK_SET);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  size_t count = parse_all(fd);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  close(fd);
+  if (argc <= 2) {
+    unlink(path);
+  }
+
+  double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%.1f MB, %zu commands in %.3f s: %.0f commands/s\n", (double)size / (1024 * 1024), count, seconds,
+         (double)count / seconds);
+  return 0;
+}
@@ -0,0 +1,203 @@
+// Teste de stress das reservas: várias threads reservam grupos de lugares
+// sobrepostos de um único evento enquanto outra faz SHOW. Verifica que
+// nenhum lugar fica em duas reservas e que nenhum SHOW mostra uma reserva a
+// meio. Uso: stress_reserve [threads] [reservas por thread]
+// O resultado vai para stdout, os erros das reservas recusadas para stderr.
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "operations.h"
+
+#define EVENT_ID 1
+#define ROWS 40
+#define COLS 40
+#define SEATS_PER_RESERVATION 3
+#define MAX_THREADS 64
+
+/// Reservations made by one thread.
+struct Reserver {
+  pthread_t thread;
+  unsigned int seed;
+  int attempts;
+  int successes;
+  size_t (*xs)[SEATS_PER_RESERVATION];  // Lugares das reservas bem-sucedidas
+  size_t (*ys)[SEATS_PER_RESERVATION];
+};
+
+static _Atomic int reserving = 1;
+
+static void* reserve_loop(void* args) {
+  struct Reserver* reserver = args;
+  for (int n = 0; n < reserver->attempts; n++) {
+    size_t xs[SEATS_PER_RESERVATION], ys[SEATS_PER_RESERVATION];
+    for (int i = 0; i < SEATS_PER_RESERVATION; i++) {
+      xs[i] = (size_t)(rand_r(&reserver->seed) % ROWS) + 1;
+      ys[i] = (size_t)(rand_r(&reserver->seed) % COLS) + 1;
+    }
+    // ems_reserve ordena os lugares, guarda-se a ordem em que ficaram
+    if (ems_reserve(EVENT_ID, SEATS_PER_RESERVATION, xs, ys) == 0) {
+      memcpy(reserver->xs[reserver->successes], xs, sizeof(xs));
+      memcpy(reserver->ys[reserver->successes], ys, sizeof(ys));
+      reserver->successes++;
+    }
+  }
+  return NULL;
+}
+
+/// Reads a SHOW of the event into seats.
+/// @return 0 if the output had every seat, 1 otherwise.
+static int read_show(int fd, unsigned int* seats) {
+  // Cada lugar ocupa no máximo 10 dígitos e um separador
+  static _Thread_local char text[ROWS * COLS * 11 + 1];
+  if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 || ems_show(fd, EVENT_ID) != 0) {
+    return 1;
+  }
+  ssize_t len = pread(fd, text, sizeof(text) - 1, 0);
+  if (len <= 0) {
+    return 1;
+  }
+  text[len] = '\0';
+
+  char* p = text;
+  for (size_t i = 0; i < ROWS * COLS; i++) {
+    char* end;
+    unsigned long seat = strtoul(p, &end, 10);
+    if (end == p || seat > UINT_MAX) {
+      return 1;
+    }
+    seats[i] = (unsigned int)seat;
+    p = end;
+  }
+  return 0;
+}
+
+/// Checks that every reservation shown has all of its seats.
+/// @return 0 if the seats are consistent, 1 otherwise.
+static int check_counts(const unsigned int* seats) {
+  static unsigned int counts[ROWS * COLS + 1];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < ROWS * COLS; i++) {
+    if (seats[i] > ROWS * COLS) {
+      printf("Unexpected reservation id %u\n", seats[i]);
+      return 1;
+    }
+    counts[seats[i]]++;
+  }
+  for (unsigned int id = 1; id <= ROWS * COLS; id++) {
+    if (counts[id] != 0 && counts[id] != SEATS_PER_RESERVATION) {
+      printf("Reservation %u shown with %u of its %d seats\n", id, counts[id], SEATS_PER_RESERVATION);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void* show_loop(void* args) {
+  int fd = *(int*)args;
+  unsigned int seats[ROWS * COLS];
+  long failed = 0;
+  while (reserving) {
+    if (read_show(fd, seats) != 0 || check_counts(seats) != 0) {
+      failed = 1;
+      break;
+    }
+  }
+  return (void*)failed;
+}
+
+int main(int argc, char* argv[]) {
+  int num_threads = argc > 1 ? atoi(argv[1]) : 8;
+  int attempts = argc > 2 ? atoi(argv[2]) : 500;
+  if (num_threads <= 0 || num_threads > MAX_THREADS || attempts <= 0) {
+    fprintf(stderr, "Usage: %s [threads (1-%d)] [reservations per thread]\n", argv[0], MAX_THREADS);
+    return 1;
+  }
+
+  FILE* file = tmpfile();
+  int fd = file != NULL ? fileno(file) : -1;
+  if (fd == -1 || ems_init(0) != 0 || ems_create(EVENT_ID, ROWS, COLS) != 0) {
+    fprintf(stderr, "Failed to set up the test\n");
+    return 1;
+  }
+
+  struct Reserver reservers[MAX_THREADS];
+  for (int t = 0; t < num_threads; t++) {
+    reservers[t].seed = (unsigned int)t + 1;
+    reservers[t].attempts = attempts;
+    reservers[t].successes = 0;
+    reservers[t].xs = malloc((size_t)attempts * sizeof(*reservers[t].xs));
+    reservers[t].ys = malloc((size_t)attempts * sizeof(*reservers[t].ys));
+    if (reservers[t].xs == NULL || reservers[t].ys == NULL) {
+      fprintf(stderr, "Error allocating memory\n");
+      return 1;
+    }
+  }
+
+  pthread_t shower;
+  if (pthread_create(&shower, NULL, show_loop, &fd) != 0) {
+    fprintf(stderr, "Failed to create thread\n");
+    return 1;
+  }
+  for (int t = 0; t < num_threads; t++) {
+    if (pthread_create(&reservers[t].thread, NULL, reserve_loop, &reservers[t]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      return 1;
+    }
+  }
+  for (int t = 0; t < num_threads; t++) {
+    pthread_join(reservers[t].thread, NULL);
+  }
+  reserving = 0;
+  void* show_failed;
+  pthread_join(shower, &show_failed);
+
+  int failed = show_failed != NULL;
+  unsigned int seats[ROWS * COLS];
+  if (read_show(fd, seats) != 0) {
+    printf("Failed to read the final SHOW\n");
+    failed = 1;
+  }
+
+  // Cada reserva aceite tem todos os seus lugares com um id só dela
+  static int used[ROWS * COLS + 1];
+  int total = 0;
+  for (int t = 0; t < num_threads && !failed; t++) {
+    for (int n = 0; n < reservers[t].successes && !failed; n++) {
+      unsigned int id = seats[(reservers[t].xs[n][0] - 1) * COLS + reservers[t].ys[n][0] - 1];
+      for (int i = 0; i < SEATS_PER_RESERVATION; i++) {
+        if (seats[(reservers[t].xs[n][i] - 1) * COLS + reservers[t].ys[n][i] - 1] != id) {
+          printf("Seat (%zu,%zu) was booked twice\n", reservers[t].xs[n][i], reservers[t].ys[n][i]);
+          failed = 1;
+        }
+      }
+      if (id == 0 || id > ROWS * COLS || used[id]++) {
+        printf("Reservation id %u given to more than one reservation\n", id);
+        failed = 1;
+      }
+      total++;
+    }
+  }
+  int booked = 0;
+  for (size_t i = 0; i < ROWS * COLS; i++) {
+    booked += seats[i] != 0;
+  }
+  if (!failed && booked != total * SEATS_PER_RESERVATION) {
+    printf("%d seats booked for %d reservations\n", booked, total);
+    failed = 1;
+  }
+
+  for (int t = 0; t < num_threads; t++) {
+    free(reservers[t].xs);
+    free(reservers[t].ys);
+  }
+  fclose(file);
+  ems_terminate();
+
+  printf("%s: %d threads, %d reservations accepted\n", failed ? "FAIL" : "OK", num_threads, total);
+  return failed;
+}
@@ -5,9 +5,10 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <string.h>
+#include <poll.h>
 #include "api.h"
 #include "common/io.h"
+#include "common/seatmap.h"
 #include "common/constants.h"
 
 struct Client* client = NULL; // Cliente
@@ -26,6 +27,12 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
   }
   strcpy(client->req_pipe_path, req_pipe_path);
   strcpy(client->resp_pipe_path, resp_pipe_path);
+  client->next_ticket = 1;
+  client->in_flight = 0;
+  for (size_t i = 0; i < EMS_MAX_IN_FLIGHT; i++) {
+    client->pending[i].ticket = 0;
+    client->pending[i].response = NULL;
+  }
 
   char message[MAX_SIZE_PATHS]; // 1 + 40 + 40 + 1
   message[0] = '1';
@@ -47,35 +54,220 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
     return 1;
   }
 
-  // Abrir pipe de response para leitura
+  // Abrir pipe de response para leitura, fica aberta até ao ems_quit
   int resp_fd = open(resp_pipe_path, O_RDONLY);
   if (resp_fd == -1) {
     fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
     return 1;
   }
-  char response_setup[sizeof(int)];
+  client->resp_fd = resp_fd;
 
   // Ler o session_id do response pipe
-  ssize_t bytesRead = read(resp_fd, response_setup, sizeof(int));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if (close(resp_fd) == -1) {
-      fprintf(stderr, "Error closing response pipe\n");
-      return 1;
-    }
-    ems_quit();
-    return 1;
-  }
-  if (close(resp_fd) == -1) {
-    fprintf(stderr, "Error closing response pipe\n");
+  char *response_setup = NULL;
+  size_t response_size;
+  if (read_msg(resp_fd, sizeof(int), &response_setup, &response_size) || response_size != sizeof(int)) {
+    fprintf(stderr, "[ERR]: read from response pipe failed\n");
+    free(response_setup);
+    close(resp_fd);
     return 1;
   }
 
   // Associar session id ao named pipe do server
   int session_id;
   memcpy(&session_id, response_setup, sizeof(int));
+  free(response_setup);
   client->session_id = session_id;
 
+  // Abrir pipe de request para escrita, fica aberta até ao ems_quit
+  int req_fd = open(req_pipe_path, O_WRONLY);
+  if (req_fd == -1) {
+    fprintf(stderr, "[ERR]: open request pipe failed: %s\n", strerror(errno));
+    close(resp_fd);
+    return 1;
+  }
+  client->req_fd = req_fd;
+
+  return 0;
+}
+
+/// Sends a request preceded by an id (EMS_TAGGED), echoed by the server in the response.
+static int send_tagged(unsigned int ticket, const char *message, size_t size) {
+  char *frame = malloc(REQUEST_TAG_SIZE + size);
+  if (frame == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+  frame[0] = '9';
+  memcpy(&frame[1], &ticket, sizeof(unsigned int));
+  memcpy(&frame[REQUEST_TAG_SIZE], message, size);
+
+  int result = print_msg(client->req_fd, frame, REQUEST_TAG_SIZE + size);
+  free(frame);
+  if (result) {
+    fprintf(stderr, "Error writing to request pipe\n");
+  }
+  return result;
+}
+
+static struct PendingRequest *find_pending(unsigned int ticket) {
+  for (size_t i = 0; i < EMS_MAX_IN_FLIGHT; i++) {
+    if (client->pending[i].ticket == ticket) {
+      return &client->pending[i];
+    }
+  }
+  return NULL;
+}
+
+/// Reads the response to a request sent with an id.
+/// @param ticket Pointer to store the id of the request in.
+/// @param response Pointer to store the response without the id in, allocated with malloc.
+/// @param response_size Pointer to store the size of the response in.
+/// @return 0 if the response was read successfully, 1 otherwise.
+static int read_tagged(unsigned int *ticket, char **response, size_t *response_size) {
+  if (read_msg(client->resp_fd, MAX_RESPONSE_SIZE, response, response_size) ||
+      *response_size < sizeof(unsigned int) + sizeof(int)) {
+    fprintf(stderr, "[ERR]: read from response pipe failed\n");
+    free(*response);
+    return 1;
+  }
+  memcpy(ticket, *response, sizeof(unsigned int));
+  *response_size -= sizeof(unsigned int);
+  memmove(*response, *response + sizeof(unsigned int), *response_size);
+  return 0;
+}
+
+/// Keeps the response to an asynchronous request until it is claimed.
+/// @return The request answered, NULL if the response does not match one in flight.
+static struct PendingRequest *store_pending(unsigned int ticket, char *response, size_t response_size) {
+  struct PendingRequest *request = ticket != 0 ? find_pending(ticket) : NULL;
+  if (request == NULL || request->done) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
+    return NULL;
+  }
+  request->done = 1;
+  request->response = response;
+  request->response_size = response_size;
+  client->in_flight--;
+  return request;
+}
+
+/// Reads the response to an asynchronous request and keeps it until claimed.
+/// @return The request answered, NULL on failure.
+static struct PendingRequest *read_pending(void) {
+  unsigned int ticket;
+  char *response = NULL;
+  size_t response_size;
+  if (read_tagged(&ticket, &response, &response_size)) {
+    return NULL;
+  }
+  return store_pending(ticket, response, response_size);
+}
+
+/// Sends a request through the request pipe and waits for the response.
+/// @param message Request to be sent.
+/// @param size Size of the request.
+/// @param response Pointer to store the response in, allocated with malloc.
+/// @param response_size Pointer to store the size of the response in.
+/// @return 0 if the response was received successfully, 1 otherwise.
+static int send_request(const char *message, size_t size, char **response, size_t *response_size) {
+  if (client->in_flight > 0) {
+    // Há respostas assíncronas por chegar: este pedido leva o id 0, e as
+    // respostas que chegarem antes ficam guardadas até serem reclamadas
+    if (send_tagged(0, message, size)) {
+      return 1;
+    }
+    while (1) {
+      unsigned int ticket;
+      if (read_tagged(&ticket, response, response_size)) {
+        *response = NULL;
+        return 1;
+      }
+      if (ticket == 0) {
+        return 0;
+      }
+      if (store_pending(ticket, *response, *response_size) == NULL) {
+        *response = NULL;
+        return 1;
+      }
+      *response = NULL;
+    }
+  }
+
+  if (print_msg(client->req_fd, message, size)) {
+    fprintf(stderr, "Error writing to request pipe\n");
+    return 1;
+  }
+
+  if (read_msg(client->resp_fd, MAX_RESPONSE_SIZE, response, response_size) || *response_size < sizeof(int)) {
+    fprintf(stderr, "[ERR]: read from response pipe failed\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+/// Sends a request with a new id, without waiting for the response.
+/// @param batch Number of reservations of an EMS_RESERVE_BATCH request, 0 otherwise.
+/// @param ticket Pointer to store the id in.
+/// @return 0 if the request was sent successfully, 1 otherwise.
+static int send_async(const char *message, size_t size, size_t batch, unsigned int *ticket) {
+  struct PendingRequest *request = find_pending(0);
+  if (request == NULL) {
+    fprintf(stderr, "Too many requests in flight\n");
+    return 1;
+  }
+
+  // O id 0 fica para os pedidos síncronos
+  unsigned int id = client->next_ticket++;
+  if (client->next_ticket == 0) {
+    client->next_ticket = 1;
+  }
+  if (send_tagged(id, message, size)) {
+    return 1;
+  }
+
+  request->ticket = id;
+  request->done = 0;
+  request->response = NULL;
+  request->batch = batch;
+  client->in_flight++;
+  *ticket = id;
+  return 0;
+}
+
+/// Frees a request whose response arrived, storing the value the synchronous call would return.
+/// @return 0 if the response is valid, 1 otherwise.
+static int claim_pending(struct PendingRequest *request, int *result) {
+  int valid = 1;
+  memcpy(result, request->response, sizeof(int));
+
+  // O resultado de um lote é o número de reservas que falharam
+  if (request->batch && *result != 0) {
+    *result = (int)request->batch;
+  } else if (request->batch) {
+    size_t num_status = 0;
+    if (request->response_size < sizeof(int) + sizeof(size_t)) {
+      valid = 0;
+    } else {
+      memcpy(&num_status, request->response + sizeof(int), sizeof(size_t));
+      valid = num_status == request->batch &&
+              request->response_size == sizeof(int) + sizeof(size_t) + num_status * sizeof(int);
+    }
+    for (size_t i = 0; valid && i < num_status; i++) {
+      int status;
+      memcpy(&status, request->response + sizeof(int) + sizeof(size_t) + i * sizeof(int), sizeof(int));
+      *result += status != 0;
+    }
+  }
+
+  free(request->response);
+  request->response = NULL;
+  request->ticket = 0;
+  if (!valid) {
+    fprintf(stderr, "Invalid response from server\n");
+    return 1;
+  }
   return 0;
 }
 
@@ -84,22 +276,19 @@ int ems_quit(void) {
   char message[1];
   message[0] = '2';
 
-  // Open request pipe to send
-  int req_fd = open(client->req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
-    fprintf(stderr, "[ERR]: open server pipe failed: %s\n", strerror(errno));
-    return 1;
-  }
-  if (print_str_size(req_fd, message, 1)) {
+  if (print_msg(client->req_fd, message, 1)) {
     fprintf(stderr, "Error writing to request pipe\n");
     return 1;
   }
-  if(close(req_fd) == -1) {
-    fprintf(stderr, "Error request pipe\n");
-    return 1;
-  }
 
   //TODO: close pipes
+  // Fecha as duas pipes mesmo que a primeira falhe
+  int req_closed = close(client->req_fd);
+  int resp_closed = close(client->resp_fd);
+  if (req_closed == -1 || resp_closed == -1) {
+    fprintf(stderr, "Error closing pipes\n");
+    return 1;
+  }
   if (unlink(client->resp_pipe_path) != 0 && errno != ENOENT) {
     fprintf(stderr, "[ERR]: unlink(%s) failed: %s\n", client->resp_pipe_path, strerror(errno));
     return 1;
@@ -109,222 +298,274 @@ int ems_quit(void) {
     return 1;
   };
   
+  for (size_t i = 0; i < EMS_MAX_IN_FLIGHT; i++) {
+    free(client->pending[i].response);
+  }
   free(client);
+  seatmap_release_shared();
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  //TODO: send create request to the server (through the request pipe) and wait for the response (through the response pipe)
-  char message[1 + sizeof(unsigned int) + 2 * sizeof(size_t)];
-  message[0] = '3';
+#define CREATE_REQUEST_SIZE (1 + sizeof(unsigned int) + 2 * sizeof(size_t))
+#define RESERVE_REQUEST_SIZE(num_seats) (1 + sizeof(unsigned int) + sizeof(size_t) + 2 * (num_seats) * sizeof(size_t))
 
+static void encode_create(char *message, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  message[0] = '3';
   memcpy(&message[1], &event_id, sizeof(unsigned int));
   memcpy(&message[1 + sizeof(unsigned int)], &num_rows, sizeof(size_t));
   memcpy(&message[1 + sizeof(unsigned int) + sizeof(size_t)], &num_cols, sizeof(size_t));
+}
 
-  // Open request pipe to send
-  int req_fd = open(client->req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
-    fprintf(stderr, "[ERR]: open server pipe failed: %s\n", strerror(errno));
-    return 1;
-  }
-  if (print_str_size(req_fd, message, 1 + sizeof(unsigned int) + 2 * sizeof(size_t))) {
-    fprintf(stderr, "Error writing to request pipe\n");
-    return 1;
-  }
-  if(close(req_fd) == -1) {
-    fprintf(stderr, "Error request pipe\n");
-    return 1;
-  }
+static void encode_reserve(char *message, unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys) {
+  message[0] = '4';
+  memcpy(&message[1], &event_id, sizeof(unsigned int));
+  memcpy(&message[1 + sizeof(unsigned int)], &num_seats, sizeof(size_t));
+  memcpy(&message[1 + sizeof(unsigned int) + sizeof(size_t)], xs, num_seats * sizeof(size_t));
+  memcpy(&message[1 + sizeof(unsigned int) + (num_seats + 1) * sizeof(size_t)], ys, num_seats * sizeof(size_t));
+}
 
-  // Open response pipe to receive
-  int resp_fd = open(client->resp_pipe_path, O_RDONLY);
-  if (resp_fd == -1) {
-    fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-    return 1;
+/// Encodes an EMS_RESERVE_BATCH request.
+/// @param size Pointer to store the size of the request in.
+/// @return The request, allocated with malloc, or NULL on failure.
+static char *encode_reserve_batch(size_t num_reservations, const struct Reservation *reservations, size_t *size) {
+  if (num_reservations == 0 || num_reservations > MAX_BATCH_SIZE) {
+    fprintf(stderr, "Invalid number of reservations in batch\n");
+    return NULL;
   }
 
-  // Read from pipe
-  char response[sizeof(int)];
-  ssize_t bytesRead = read(resp_fd, response, sizeof(response));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if (close(resp_fd) == -1) {
-      fprintf(stderr, "Error response pipe\n");
-      return 1;
-    }
-    return 1;
+  *size = 1 + sizeof(size_t);
+  for (size_t i = 0; i < num_reservations; i++) {
+    *size += sizeof(unsigned int) + sizeof(size_t) + 2 * reservations[i].num_seats * sizeof(size_t);
   }
-  if (close(resp_fd) == -1) {
-    fprintf(stderr, "Error response pipe\n");
+  char *message = malloc(*size);
+  if (message == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return NULL;
+  }
+
+  message[0] = '8';
+  memcpy(&message[1], &num_reservations, sizeof(size_t));
+  size_t offset = 1 + sizeof(size_t);
+  for (size_t i = 0; i < num_reservations; i++) {
+    const struct Reservation *reservation = &reservations[i];
+    size_t seats_size = reservation->num_seats * sizeof(size_t);
+    memcpy(&message[offset], &reservation->event_id, sizeof(unsigned int));
+    memcpy(&message[offset + sizeof(unsigned int)], &reservation->num_seats, sizeof(size_t));
+    offset += sizeof(unsigned int) + sizeof(size_t);
+    memcpy(&message[offset], reservation->xs, seats_size);
+    memcpy(&message[offset + seats_size], reservation->ys, seats_size);
+    offset += 2 * seats_size;
+  }
+  return message;
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  //TODO: send create request to the server (through the request pipe) and wait for the response (through the response pipe)
+  char message[CREATE_REQUEST_SIZE];
+  encode_create(message, event_id, num_rows, num_cols);
+
+  char *response = NULL;
+  size_t response_size;
+  if (send_request(message, sizeof(message), &response, &response_size)) {
+    free(response);
     return 1;
   }
 
   int response_val;
-  memcpy(&response_val, &response, sizeof(int));
+  memcpy(&response_val, response, sizeof(int));
+  free(response);
 
   return response_val;
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
   //TODO: send reserve request to the server (through the request pipe) and wait for the response (through the response pipe)
-  char message[1 + sizeof(unsigned int) + sizeof(size_t) + 2 * (num_seats * sizeof(size_t))];
-  message[0] = '4';
-
-  memcpy(&message[1], &event_id, sizeof(unsigned int));
-  memcpy(&message[1 + sizeof(unsigned int)], &num_seats, sizeof(size_t));
-  memcpy(&message[1 + sizeof(unsigned int) + sizeof(size_t)], xs, num_seats * sizeof(size_t));
-  memcpy(&message[1 + sizeof(unsigned int) + (num_seats + 1) * sizeof(size_t)], ys, num_seats * sizeof(size_t));
+  char message[RESERVE_REQUEST_SIZE(num_seats)];
+  encode_reserve(message, event_id, num_seats, xs, ys);
 
-  // Open request pipe to send
-  int req_fd = open(client->req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
-    fprintf(stderr, "[ERR]: open server pipe failed: %s\n", strerror(errno));
+  char *response = NULL;
+  size_t response_size;
+  if (send_request(message, sizeof(message), &response, &response_size)) {
+    free(response);
     return 1;
   }
-  if (print_str_size(req_fd, message, 1 + sizeof(unsigned int) + sizeof(size_t) + 2 * (num_seats * sizeof(size_t)))) {
-    fprintf(stderr, "Error writing to request pipe\n");
+
+  int response_val;
+  memcpy(&response_val, response, sizeof(int));
+  free(response);
+
+  return response_val;
+}
+
+int ems_reserve_batch(size_t num_reservations, const struct Reservation* reservations, int* status) {
+  size_t size;
+  char *message = encode_reserve_batch(num_reservations, reservations, &size);
+  if (message == NULL) {
     return 1;
   }
-  if(close(req_fd) == -1) {
-    fprintf(stderr, "Error request pipe\n");
+
+  char *response = NULL;
+  size_t response_size;
+  int failed = send_request(message, size, &response, &response_size);
+  free(message);
+  if (failed) {
+    free(response);
     return 1;
   }
 
-  // Open response pipe to receive
-  int resp_fd = open(client->resp_pipe_path, O_RDONLY);
-  if (resp_fd == -1) {
-    fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-    return 1;
+  int response_val;
+  memcpy(&response_val, response, sizeof(int));
+  if (response_val) {
+    free(response);
+    return response_val;
   }
 
-  // Read from pipe
-  char response[sizeof(int)];
-  ssize_t bytesRead = read(resp_fd, response, sizeof(response));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if(close(resp_fd) == -1) {
-      fprintf(stderr, "Error response pipe\n");
-      return 1;
-    }
+  size_t num_status;
+  if (response_size != sizeof(int) + sizeof(size_t) + num_reservations * sizeof(int)) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
     return 1;
   }
-  if (close(resp_fd) == -1) {
-    fprintf(stderr, "Error response pipe\n");
+  memcpy(&num_status, response + sizeof(int), sizeof(size_t));
+  if (num_status != num_reservations) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
     return 1;
   }
-
-  int response_val;
-  memcpy(&response_val, &response, sizeof(int));
-
-  return response_val;
+  memcpy(status, response + sizeof(int) + sizeof(size_t), num_reservations * sizeof(int));
+  free(response);
+  return 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  //TODO: send show request to the server (through the request pipe) and wait for the response (through the response pipe)
-  char message[1 + sizeof(unsigned int)];
-  message[0] = '5';
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols, unsigned int* ticket) {
+  char message[CREATE_REQUEST_SIZE];
+  encode_create(message, event_id, num_rows, num_cols);
+  return send_async(message, sizeof(message), 0, ticket);
+}
 
-  memcpy(&message[1], &event_id, sizeof(unsigned int));
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys, unsigned int* ticket) {
+  char message[RESERVE_REQUEST_SIZE(num_seats)];
+  encode_reserve(message, event_id, num_seats, xs, ys);
+  return send_async(message, sizeof(message), 0, ticket);
+}
 
-  // Open request pipe to send
-  int req_fd = open(client->req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
-    fprintf(stderr, "[ERR]: open request pipe failed: %s\n", strerror(errno));
-    return 1;
-  }
-  if (print_str_size(req_fd, message, 1 + sizeof(unsigned int))) {
-    fprintf(stderr, "Error writing to request pipe\n");
+int ems_reserve_batch_async(size_t num_reservations, const struct Reservation* reservations, unsigned int* ticket) {
+  size_t size;
+  char *message = encode_reserve_batch(num_reservations, reservations, &size);
+  if (message == NULL) {
     return 1;
   }
-  if (close(req_fd) == -1) {
-    fprintf(stderr, "Error request pipe\n");
-    return 1;
+  int result = send_async(message, size, num_reservations, ticket);
+  free(message);
+  return result;
+}
+
+int ems_poll(unsigned int ticket, int* result) {
+  struct PendingRequest *request = ticket != 0 ? find_pending(ticket) : NULL;
+  if (request == NULL) {
+    return -1;
   }
 
-  // Open response pipe to receive
-  int resp_fd = open(client->resp_pipe_path, O_RDONLY);
-  if (resp_fd == -1) {
-    fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-    return 1;
+  // Só lê as respostas que já estão na pipe
+  while (!request->done) {
+    struct pollfd fds = {.fd = client->resp_fd, .events = POLLIN};
+    int ready = poll(&fds, 1, 0);
+    if (ready == -1 && errno == EINTR) {
+      continue;
+    }
+    if (ready == -1) {
+      fprintf(stderr, "[ERR]: poll failed: %s\n", strerror(errno));
+      return -1;
+    }
+    if (ready == 0) {
+      return 0;
+    }
+    if (read_pending() == NULL) {
+      return -1;
+    }
   }
 
-  // Read from pipe
-  char *response = malloc(sizeof(int) + 2 * sizeof(size_t));
-  if (response == NULL) {
-    fprintf(stderr, "Error allocating memory\n");
-    return 1;
+  return claim_pending(request, result) ? -1 : 1;
+}
+
+int ems_wait_any(unsigned int* ticket, int* result) {
+  struct PendingRequest *request = NULL;
+  for (size_t i = 0; i < EMS_MAX_IN_FLIGHT && request == NULL; i++) {
+    if (client->pending[i].ticket != 0 && client->pending[i].done) {
+      request = &client->pending[i];
+    }
   }
-  ssize_t bytesRead = read(resp_fd, response, sizeof(int) + 2 * sizeof(size_t));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if(close(resp_fd) == -1) {
-      fprintf(stderr, "Error reponse pipe\n");
+
+  if (request == NULL) {
+    if (client->in_flight == 0) {
       return 1;
     }
+    request = read_pending();
+    if (request == NULL) {
+      return 1;
+    }
+  }
+
+  *ticket = request->ticket;
+  return claim_pending(request, result);
+}
+
+int ems_show(int out_fd, unsigned int event_id) {
+  //TODO: send show request to the server (through the request pipe) and wait for the response (through the response pipe)
+  char message[1 + sizeof(unsigned int)];
+  message[0] = '5';
+
+  memcpy(&message[1], &event_id, sizeof(unsigned int));
+
+  char *response = NULL;
+  size_t response_size;
+  if (send_request(message, sizeof(message), &response, &response_size)) {
+    free(response);
     return 1;
   }
+
   int response_val;
-  size_t num_rows, num_cols;
   memcpy(&response_val, response, sizeof(int));
   
   if(response_val) {
     free(response);
     return response_val;
   }
-  memcpy(&num_rows, response + sizeof(int), sizeof(size_t));
-  memcpy(&num_cols, response + (sizeof(int) + sizeof(size_t)), sizeof(size_t));
 
-  free(response);
-  response = malloc(num_rows * num_cols * sizeof(size_t));
-  if(response == NULL) {
-    fprintf(stderr, "Error allocating memory\n");
+  size_t num_rows, num_cols;
+  unsigned int *seats = NULL;
+  if (seatmap_decode(response + sizeof(int), response_size - sizeof(int), &num_rows, &num_cols, &seats)) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
     return 1;
   }
+  free(response);
 
-  
-  bytesRead = read(resp_fd, response, (num_rows * num_cols) * sizeof(unsigned int));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if(close(resp_fd) == -1) {
-      fprintf(stderr, "Error response pipe\n");
-      return 1;
-    }
-    return 1;
-  }
-  if (close(resp_fd) == -1) {
-    fprintf(stderr, "Error response pipe\n");
+  // Cada linha é escrita de uma vez: até 10 dígitos e um separador por lugar
+  char *line = malloc(num_cols * 11 + 1);
+  if (line == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    free(seats);
     return 1;
   }
 
   // Write to output file
-  for (size_t i = 1; i <= num_rows; i++) {
-    for (size_t j = 1; j <= num_cols; j++) {
-      char buffer[16];
-      size_t a;
-      memcpy(&a, response + (sizeof(size_t) * ((i - 1) * num_cols + j - 1)), sizeof(size_t));
-      sprintf(buffer, "%lu", a);
-
-      if (print_str(out_fd, buffer)) {
-        perror("Error writing to file descriptor");
-        return 1;
-      }
-
-      if (j < num_cols) {
-        if (print_str(out_fd, " ")) {
-          perror("Error writing to file descriptor");
-          return 1;
-        }
-      }
-
+  for (size_t i = 0; i < num_rows; i++) {
+    size_t len = 0;
+    for (size_t j = 0; j < num_cols; j++) {
+      len += (size_t)sprintf(line + len, j < num_cols - 1 ? "%u " : "%u", seats[i * num_cols + j]);
     }
-    if (print_str(out_fd, "\n")) {
+    line[len++] = '\n';
+
+    if (print_str_size(out_fd, line, len)) {
       perror("Error writing to file descriptor");
+      free(line);
+      free(seats);
       return 1;
     }
-
   }
-  free(response);
+  free(line);
+  free(seats);
   return response_val;
 }
 
@@ -333,43 +574,13 @@ int ems_list_events(int out_fd) {
   char message[1];
   message[0] = '6';
 
-  // Open request pipe to send
-  int req_fd = open(client->req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
-    fprintf(stderr, "[ERR]: open request pipe failed: %s\n", strerror(errno));
-    return 1;
-  }
-  if (print_str_size(req_fd, message, 1)) {
-    fprintf(stderr, "Error writing to request pipe\n");
-    return 1;
-  };
-  if(close(req_fd) == -1) {
-    fprintf(stderr, "Error request pipe\n");
-    return 1;
-  }
-
-  // Open response pipe to receive
-  int resp_fd = open(client->resp_pipe_path, O_RDONLY);
-  if (resp_fd == -1) {
-    fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
+  char *response = NULL;
+  size_t response_size;
+  if (send_request(message, sizeof(message), &response, &response_size)) {
+    free(response);
     return 1;
   }
 
-  // Read from pipe
-  char *response = malloc(sizeof(int) + sizeof(size_t));
-  if (response == NULL) {
-    fprintf(stderr, "Error allocating memory\n");
-    return 1;
-  }
-  ssize_t bytesRead = read(resp_fd, response, sizeof(int) + sizeof(size_t));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if(close(resp_fd) == -1) {
-      fprintf(stderr, "Error response pipe\n");
-      return 1;
-    }
-    return 1;
-  }
   int response_val;
   size_t num_events;
   memcpy(&response_val, response, sizeof(int));
@@ -377,26 +588,17 @@ int ems_list_events(int out_fd) {
     free(response);
     return response_val;
   }
-  memcpy(&num_events, response + sizeof(int), sizeof(size_t));
-
-  free(response);
-  response = malloc(num_events * sizeof(unsigned int));
-  if (response == NULL) {
-    fprintf(stderr, "Error allocating memory\n");
+  if (response_size < sizeof(int) + sizeof(size_t)) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
     return 1;
   }
+  memcpy(&num_events, response + sizeof(int), sizeof(size_t));
 
-  bytesRead = read(resp_fd, response, num_events * sizeof(unsigned int));
-  if (bytesRead == -1) {
-    fprintf(stderr, "[ERR]: read from response pipe failed: %s\n", strerror(errno));
-    if (close(resp_fd) == -1) {
-      fprintf(stderr, "Error response pipe\n");
-      return 1;
-    }
-    return 1;
-  }
-  if(close(resp_fd) == -1) {
-    fprintf(stderr, "Error response pipe\n");
+  char *ids = response + sizeof(int) + sizeof(size_t);
+  if (response_size - (sizeof(int) + sizeof(size_t)) < num_events * sizeof(unsigned int)) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
     return 1;
   }
 
@@ -414,7 +616,7 @@ int ems_list_events(int out_fd) {
         return 1;
       }
       unsigned int temp;
-      memcpy(&temp, response + i * sizeof(unsigned int), sizeof(unsigned int));
+      memcpy(&temp, ids + i * sizeof(unsigned int), sizeof(unsigned int));
 
       char id[16];
       sprintf(id, "%u\n", temp);
@@ -424,5 +626,47 @@ int ems_list_events(int out_fd) {
       }
     }
   }
+  free(response);
   return response_val;
-}
\ No newline at end of file
+}
+
+int ems_stats(int out_fd) {
+  char message[1];
+  message[0] = '0';
+
+  char *response = NULL;
+  size_t response_size;
+  if (send_request(message, sizeof(message), &response, &response_size)) {
+    free(response);
+    return 1;
+  }
+
+  int response_val;
+  memcpy(&response_val, response, sizeof(int));
+  if (response_val) {
+    free(response);
+    return response_val;
+  }
+
+  size_t text_size;
+  if (response_size < sizeof(int) + sizeof(size_t)) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
+    return 1;
+  }
+  memcpy(&text_size, response + sizeof(int), sizeof(size_t));
+  if (response_size - (sizeof(int) + sizeof(size_t)) < text_size) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(response);
+    return 1;
+  }
+
+  // A tabela já vem formatada pelo servidor
+  if (print_str_size(out_fd, response + sizeof(int) + sizeof(size_t), text_size)) {
+    fprintf(stderr, "Error writing to stdout\n");
+    free(response);
+    return 1;
+  }
+  free(response);
+  return 0;
+}
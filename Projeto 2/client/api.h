@@ -5,6 +5,17 @@
 
 #include <unistd.h>
 
+#define EMS_MAX_IN_FLIGHT 64  // Pedidos assíncronos por reclamar numa sessão
+
+/// Request sent with an id, until its result is claimed.
+struct PendingRequest {
+    unsigned int ticket;  // Id of the request, 0 if the slot is free
+    int done;             // Whether the response already arrived
+    char *response;       // Response without the id, allocated with malloc
+    size_t response_size;
+    size_t batch;         // Number of reservations of an EMS_RESERVE_BATCH request, 0 otherwise
+};
+
 struct Client {
     char req_pipe_path[40];  // Caminho do named pipe para requests
     char resp_pipe_path[40]; // Caminho do named pipe para responses
@@ -12,8 +23,18 @@ struct Client {
     int req_fd;                // File descriptor of request pipe
     int resp_fd;               // File descriptor of response pipe
     int out_fd;                // File descriptor of output file
+    unsigned int next_ticket;  // Id of the next request sent with an id
+    size_t in_flight;          // Requests sent with an id whose response did not arrive
+    struct PendingRequest pending[EMS_MAX_IN_FLIGHT];
 };
 
+/// One reservation of a batch.
+struct Reservation {
+    unsigned int event_id;  // Id of the event
+    size_t num_seats;       // Number of seats to reserve
+    size_t *xs;             // Rows of the seats
+    size_t *ys;             // Columns of the seats
+};
 
 /// Connects to an EMS server.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
@@ -41,6 +62,58 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Creates several independent reservations in a single request.
+/// Each reservation is made in full or not at all, regardless of the others.
+/// @param num_reservations Number of reservations, at most MAX_BATCH_SIZE,
+/// with at most MAX_BATCH_SEATS seats in total.
+/// @param reservations Reservations to create, in order.
+/// @param status Array to store 0 in for each reservation created, 1 otherwise.
+/// @return 0 if the batch was executed, 1 otherwise.
+int ems_reserve_batch(size_t num_reservations, const struct Reservation* reservations, int* status);
+
+/// Sends a CREATE request without waiting for the response.
+/// @note Requests of a session are executed in the order they were sent, but
+/// their responses may be claimed in any order with ems_poll or ems_wait_any.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @param ticket Pointer to store the id of the request in.
+/// @return 0 if the request was sent, 1 if it failed or EMS_MAX_IN_FLIGHT
+/// requests are still unclaimed.
+int ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols, unsigned int* ticket);
+
+/// Sends a RESERVE request without waiting for the response.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param ticket Pointer to store the id of the request in.
+/// @return 0 if the request was sent, 1 if it failed or EMS_MAX_IN_FLIGHT
+/// requests are still unclaimed.
+int ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys, unsigned int* ticket);
+
+/// Sends a batch of reservations without waiting for the response. Its
+/// result is the number of reservations that could not be created.
+/// @param num_reservations Number of reservations, as in ems_reserve_batch.
+/// @param reservations Reservations to create, in order.
+/// @param ticket Pointer to store the id of the request in.
+/// @return 0 if the request was sent, 1 if it failed or EMS_MAX_IN_FLIGHT
+/// requests are still unclaimed.
+int ems_reserve_batch_async(size_t num_reservations, const struct Reservation* reservations, unsigned int* ticket);
+
+/// Claims the result of a request if its response already arrived, without blocking.
+/// @param ticket Id of the request.
+/// @param result Pointer to store the result in, the value the synchronous call would return.
+/// @return 1 if the result was claimed, 0 if the response did not arrive yet,
+/// -1 if the ticket is unknown or the response could not be read.
+int ems_poll(unsigned int ticket, int* result);
+
+/// Blocks until the response to any request sent with an id arrives, and claims it.
+/// @param ticket Pointer to store the id of the request in.
+/// @param result Pointer to store the result in, the value the synchronous call would return.
+/// @return 0 if a result was claimed, 1 if there is no request to wait for or on failure.
+int ems_wait_any(unsigned int* ticket, int* result);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
@@ -52,4 +125,10 @@ int ems_show(int out_fd, unsigned int event_id);
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Prints the counters and latency percentiles of each operation, as kept
+/// by the server, to the given file.
+/// @param out_fd File descriptor to print the table to.
+/// @return 0 if the table was printed successfully, 1 otherwise.
+int ems_stats(int out_fd);
+
 #endif  // CLIENT_API_H
@@ -9,6 +9,101 @@
 #include "common/constants.h"
 #include "parser.h"
 
+// Reservas seguidas do ficheiro, enviadas num só pedido
+struct Batch {
+  struct Reservation reservations[MAX_BATCH_SIZE];
+  size_t xs[MAX_BATCH_SEATS], ys[MAX_BATCH_SEATS];
+  size_t num_reservations;
+  size_t num_seats;
+};
+
+// Pedidos enviados sem esperar pela resposta
+struct InFlight {
+  unsigned int tickets[EMS_MAX_IN_FLIGHT];
+  size_t num_reservations[EMS_MAX_IN_FLIGHT];  // 0 para um CREATE
+  size_t count;
+};
+
+static void report_failure(size_t num_reservations, int failures) {
+  if (num_reservations == 0) {
+    if (failures) fprintf(stderr, "Failed to create event\n");
+    return;
+  }
+  for (int i = 0; i < failures; i++) {
+    fprintf(stderr, "Failed to reserve seats\n");
+  }
+}
+
+/// Waits for the response to one of the requests in flight and reports it.
+static void wait_one(struct InFlight* in_flight) {
+  unsigned int ticket;
+  int result;
+  if (ems_wait_any(&ticket, &result)) {
+    // Sem resposta nenhum dos pedidos em curso pode ser dado como feito
+    for (size_t i = 0; i < in_flight->count; i++) {
+      size_t num_reservations = in_flight->num_reservations[i];
+      report_failure(num_reservations, num_reservations > 0 ? (int)num_reservations : 1);
+    }
+    in_flight->count = 0;
+    return;
+  }
+
+  for (size_t i = 0; i < in_flight->count; i++) {
+    if (in_flight->tickets[i] == ticket) {
+      report_failure(in_flight->num_reservations[i], result);
+      in_flight->count--;
+      in_flight->tickets[i] = in_flight->tickets[in_flight->count];
+      in_flight->num_reservations[i] = in_flight->num_reservations[in_flight->count];
+      return;
+    }
+  }
+}
+
+/// Makes room for one more request in flight.
+static void reserve_in_flight(struct InFlight* in_flight) {
+  if (in_flight->count == EMS_MAX_IN_FLIGHT) {
+    wait_one(in_flight);
+  }
+}
+
+static void add_in_flight(struct InFlight* in_flight, unsigned int ticket, size_t num_reservations) {
+  in_flight->tickets[in_flight->count] = ticket;
+  in_flight->num_reservations[in_flight->count] = num_reservations;
+  in_flight->count++;
+}
+
+/// Sends the pending reservations, if any, and empties the batch.
+static void flush_reservations(struct Batch* batch, struct InFlight* in_flight) {
+  if (batch->num_reservations == 0) return;
+
+  unsigned int ticket;
+  reserve_in_flight(in_flight);
+  if (ems_reserve_batch_async(batch->num_reservations, batch->reservations, &ticket)) {
+    report_failure(batch->num_reservations, (int)batch->num_reservations);
+  } else {
+    add_in_flight(in_flight, ticket, batch->num_reservations);
+  }
+  batch->num_reservations = 0;
+  batch->num_seats = 0;
+}
+
+/// Adds a reservation to the batch, sending the batch first if it is full.
+static void add_reservation(struct Batch* batch, struct InFlight* in_flight, unsigned int event_id, size_t num_seats,
+                            size_t* xs, size_t* ys) {
+  if (batch->num_reservations == MAX_BATCH_SIZE || num_seats > MAX_BATCH_SEATS - batch->num_seats) {
+    flush_reservations(batch, in_flight);
+  }
+
+  struct Reservation* reservation = &batch->reservations[batch->num_reservations++];
+  reservation->event_id = event_id;
+  reservation->num_seats = num_seats;
+  reservation->xs = &batch->xs[batch->num_seats];
+  reservation->ys = &batch->ys[batch->num_seats];
+  memcpy(reservation->xs, xs, num_seats * sizeof(size_t));
+  memcpy(reservation->ys, ys, num_seats * sizeof(size_t));
+  batch->num_seats += num_seats;
+}
+
 int main(int argc, char* argv[]) {
   if (argc < 5) {
     fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
@@ -44,20 +139,37 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  struct Batch batch = {.num_reservations = 0, .num_seats = 0};
+  // CREATE e RESERVE não esperam pela resposta: os pedidos de uma sessão são
+  // executados por ordem, por isso um SHOW ou LIST seguinte já os vê
+  struct InFlight in_flight = {.count = 0};
+
   while (1) {
     unsigned int event_id;
     size_t num_rows, num_columns, num_coords;
     unsigned int delay = 0;
     size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
 
-    switch (get_next(in_fd)) {
+    enum Command command = get_next(in_fd);
+    // As reservas acumuladas vão antes de qualquer outro comando
+    if (command != CMD_RESERVE && command != CMD_EMPTY) {
+      flush_reservations(&batch, &in_flight);
+    }
+
+    switch (command) {
       case CMD_CREATE:
         if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
+        unsigned int ticket;
+        reserve_in_flight(&in_flight);
+        if (ems_create_async(event_id, num_rows, num_columns, &ticket)) {
+          fprintf(stderr, "Failed to create event\n");
+        } else {
+          add_in_flight(&in_flight, ticket, 0);
+        }
         break;
 
       case CMD_RESERVE:
@@ -68,7 +180,7 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        add_reservation(&batch, &in_flight, event_id, num_coords, xs, ys);
         break;
 
       case CMD_SHOW:
@@ -84,6 +196,10 @@ int main(int argc, char* argv[]) {
         if (ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
         break;
 
+      case CMD_STATS:
+        if (ems_stats(out_fd)) fprintf(stderr, "Failed to get stats\n");
+        break;
+
       case CMD_WAIT:
         if (parse_wait(in_fd, &delay, NULL) == -1) {
             fprintf(stderr, "Invalid command. See HELP for usage\n");
@@ -107,6 +223,7 @@ int main(int argc, char* argv[]) {
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
             "  SHOW <event_id>\n"
             "  LIST\n"
+            "  STATS\n"
             "  WAIT <delay_ms>\n"
             "  HELP\n");
 
@@ -116,6 +233,9 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
+        while (in_flight.count > 0) {
+          wait_one(&in_flight);
+        }
         if (close(in_fd) == - 1) {
           fprintf(stderr, "Error closing input fd\n");
           return 1;
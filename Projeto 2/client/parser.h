@@ -8,6 +8,7 @@ enum Command {
   CMD_RESERVE,
   CMD_SHOW,
   CMD_LIST_EVENTS,
+  CMD_STATS,
   CMD_WAIT,
   CMD_HELP,
   CMD_EMPTY,
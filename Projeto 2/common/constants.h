@@ -1,6 +1,22 @@
 #define MAX_RESERVATION_SIZE 256
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
 #define MAX_JOB_FILE_NAME_SIZE 256
-#define MAX_SESSION_COUNT 5
+#define MAX_WORKER_COUNT 1024
+#define EVENT_SHARDS 16  // Partes em que se dividem os eventos, por omissão
+#define MAX_EVENT_SHARDS 1024
+#define SNAPSHOT_INTERVAL_S 30  // Entre snapshots do estado, quando há log
 #define MAX_WAIT_LIST 4
-#define MAX_SIZE_PATHS 82
\ No newline at end of file
+#define REQUESTS_PER_REGISTRATION 8  // Pedidos de sessões abertas servidos antes de um novo SETUP à espera
+#define MAX_SIZE_PATHS 82
+#define MAX_BATCH_SIZE 64       // Reservas num pedido EMS_RESERVE_BATCH
+#define MAX_BATCH_SEATS 1024    // Lugares no total num pedido EMS_RESERVE_BATCH
+#define MAX_RESERVE_REQUEST_SIZE (1 + sizeof(unsigned int) + sizeof(size_t) + 2 * MAX_RESERVATION_SIZE * sizeof(size_t))
+#define MAX_BATCH_REQUEST_SIZE \
+  (1 + sizeof(size_t) + MAX_BATCH_SIZE * (sizeof(unsigned int) + sizeof(size_t)) + 2 * MAX_BATCH_SEATS * sizeof(size_t))
+#define REQUEST_TAG_SIZE (1 + sizeof(unsigned int))  // Prefixo de um pedido EMS_TAGGED
+#define MAX_REQUEST_SIZE                                                                                \
+  (REQUEST_TAG_SIZE +                                                                                   \
+   (MAX_BATCH_REQUEST_SIZE > MAX_RESERVE_REQUEST_SIZE ? MAX_BATCH_REQUEST_SIZE : MAX_RESERVE_REQUEST_SIZE))
+// Maior resposta que o cliente aceita: um SHOW de 16M lugares com ids de 32 bits
+#define MAX_RESPONSE_SIZE ((size_t)64 << 20)
+#define MAX_EPOLL_EVENTS 64
\ No newline at end of file
@@ -1,21 +1,57 @@
 #include "io.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stddef.h>
 
+#define READ_BUFFER_SIZE 65536
+
+// Buffer de leitura, evita uma chamada a read() por cada caracter
+struct Reader {
+  int fd;      // File descriptor associado ao buffer
+  size_t pos;  // Próximo caracter a consumir
+  size_t len;  // Número de caracteres válidos no buffer
+  char buf[READ_BUFFER_SIZE];
+};
+
+static struct Reader reader = {.fd = -1, .pos = 0, .len = 0};
+
+int read_char(int fd, char *ch) {
+  if (reader.fd != fd) {
+    reader.fd = fd;
+    reader.pos = 0;
+    reader.len = 0;
+  }
+
+  if (reader.pos == reader.len) {
+    ssize_t read_bytes = read(fd, reader.buf, READ_BUFFER_SIZE);
+    if (read_bytes <= 0) {
+      reader.fd = -1;
+      reader.pos = 0;
+      reader.len = 0;
+      return read_bytes == 0 ? 0 : -1;
+    }
+    reader.pos = 0;
+    reader.len = (size_t)read_bytes;
+  }
+
+  *ch = reader.buf[reader.pos++];
+  return 1;
+}
 
 int parse_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
   int i = 0;
   while (1) {
-    ssize_t read_bytes = read(fd, buf + i, 1);
+    int read_bytes = read_char(fd, buf + i);
     if (read_bytes == -1) {
       return 1;
     } else if (read_bytes == 0) {
+      buf[i] = '\0';
       *next = '\0';
       break;
     }
@@ -93,3 +129,57 @@ int print_str_size(int fd, const char *str, size_t size) {
 
   return 0;
 }
+
+int read_str_size(int fd, char *str, size_t size) {
+  while (size > 0) {
+    ssize_t read_bytes = read(fd, str, size);
+    if (read_bytes == -1 && errno == EINTR) {
+      continue;
+    }
+    if (read_bytes <= 0) {
+      return 1;
+    }
+
+    str += (size_t)read_bytes;
+    size -= (size_t)read_bytes;
+  }
+
+  return 0;
+}
+
+int print_msg(int fd, const char *msg, size_t size) {
+  // Cabeçalho e mensagem numa só escrita
+  char *frame = malloc(sizeof(size_t) + size);
+  if (frame == NULL) {
+    return 1;
+  }
+  memcpy(frame, &size, sizeof(size_t));
+  memcpy(frame + sizeof(size_t), msg, size);
+
+  int result = print_str_size(fd, frame, sizeof(size_t) + size);
+  free(frame);
+  return result;
+}
+
+int read_msg(int fd, size_t max_size, char **msg, size_t *size) {
+  *msg = NULL;
+  if (read_str_size(fd, (char *)size, sizeof(size_t))) {
+    return 1;
+  }
+  // O tamanho vem do outro lado da pipe, não se aloca mais do que o esperado
+  if (*size > max_size) {
+    return 1;
+  }
+
+  *msg = malloc(*size > 0 ? *size : 1);
+  if (*msg == NULL) {
+    return 1;
+  }
+  if (read_str_size(fd, *msg, *size)) {
+    free(*msg);
+    *msg = NULL;
+    return 1;
+  }
+
+  return 0;
+}
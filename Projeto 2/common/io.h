@@ -2,6 +2,14 @@
 #define COMMON_IO_H
 #include <stddef.h>
 
+/// Reads the next character from the given file descriptor.
+/// @note Input is buffered in large chunks, so the descriptor must not be
+/// read by other means while it is being parsed.
+/// @param fd The file descriptor to read from.
+/// @param ch Pointer to the variable to store the character in.
+/// @return 1 if a character was read, 0 at the end of the file, -1 on error.
+int read_char(int fd, char *ch);
+
 /// Parses an unsigned integer from the given file descriptor.
 /// @param fd The file descriptor to read from.
 /// @param value Pointer to the variable to store the value in.
@@ -28,4 +36,28 @@ int print_str(int fd, const char *str);
 /// @return 0 if the string was written successfully, 1 otherwise.
 int print_str_size(int fd, const char *str, size_t size);
 
+/// Reads exactly size bytes from the given file descriptor.
+/// @param fd The file descriptor to read from.
+/// @param str The buffer to store the bytes in.
+/// @param size The number of bytes to read.
+/// @return 0 if all the bytes were read, 1 on error or end of file.
+int read_str_size(int fd, char *str, size_t size);
+
+/// Writes a message preceded by its size, so that several messages can
+/// be sent over the same descriptor.
+/// @param fd The file descriptor to write to.
+/// @param msg The message to write.
+/// @param size The size of the message.
+/// @return 0 if the message was written successfully, 1 otherwise.
+int print_msg(int fd, const char *msg, size_t size);
+
+/// Reads a message written by print_msg.
+/// @param fd The file descriptor to read from.
+/// @param max_size Largest size accepted, checked before allocating.
+/// @param msg Pointer to store the message in, allocated with malloc, or NULL on failure.
+/// @param size Pointer to store the size of the message in.
+/// @return 0 if the message was read successfully, 1 on error, end of file
+/// or a message larger than max_size.
+int read_msg(int fd, size_t max_size, char **msg, size_t *size);
+
 #endif  // COMMON_IO_H
@@ -0,0 +1,349 @@
+#include "seatmap.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Segmentos já mapeados pelo cliente, do mais para o menos usado
+struct SharedMapping {
+  char name[SEATMAP_SHM_NAME_SIZE];
+  const struct SharedSeatMap *map;
+  size_t size;
+  struct SharedMapping *next;
+};
+
+static struct SharedMapping *mappings = NULL;
+static size_t num_mappings = 0;
+
+static size_t varint_size(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static size_t put_varint(char *out, uint32_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    out[size++] = (char)((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out[size++] = (char)value;
+  return size;
+}
+
+static int get_varint(const char *in, size_t size, size_t *pos, uint32_t *value) {
+  uint32_t result = 0;
+  for (unsigned int shift = 0; shift < 32; shift += 7) {
+    if (*pos >= size) {
+      return 1;
+    }
+    unsigned char byte = (unsigned char)in[(*pos)++];
+    result |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/// Number of seats of the venue, or 0 if it does not fit the format.
+static size_t seat_count(size_t rows, size_t cols) {
+  if (rows > UINT32_MAX || cols > UINT32_MAX) {
+    return 0;
+  }
+  if (rows != 0 && cols > UINT32_MAX / rows) {
+    return 0;
+  }
+  return rows * cols;
+}
+
+size_t seatmap_max_size(size_t rows, size_t cols) {
+  if (seat_count(rows, cols) == 0 && rows != 0 && cols != 0) {
+    return 0;
+  }
+  // Só se usa RLE quando é mais pequeno que o formato RAW
+  return SEATMAP_HEADER_SIZE + seat_count(rows, cols) * sizeof(uint32_t);
+}
+
+size_t seatmap_encode(char *out, size_t rows, size_t cols, const unsigned int *seats) {
+  if (seatmap_max_size(rows, cols) == 0) {
+    return 0;
+  }
+  size_t num_seats = seat_count(rows, cols);
+
+  // Uma passagem para escolher a codificação: tamanho com RLE e maior id
+  unsigned int max_id = 0;
+  size_t rle_size = 0;
+  for (size_t i = 0; i < num_seats;) {
+    size_t j = i + 1;
+    while (j < num_seats && seats[j] == seats[i]) {
+      j++;
+    }
+    rle_size += varint_size((uint32_t)(j - i)) + varint_size(seats[i]);
+    if (seats[i] > max_id) {
+      max_id = seats[i];
+    }
+    i = j;
+  }
+  unsigned char width = max_id <= UINT8_MAX ? 1 : max_id <= UINT16_MAX ? 2 : 4;
+  // RLE só compensa se reduzir o tamanho a menos de metade, o RAW descodifica-se muito mais depressa
+  unsigned char encoding = 2 * rle_size < num_seats * width ? SEATMAP_RLE : SEATMAP_RAW;
+
+  uint32_t dims[2] = {(uint32_t)rows, (uint32_t)cols};
+  out[0] = SEATMAP_VERSION;
+  out[1] = (char)encoding;
+  out[2] = (char)(encoding == SEATMAP_RAW ? width : 0);
+  memcpy(out + 3, dims, sizeof(dims));
+  size_t pos = SEATMAP_HEADER_SIZE;
+
+  if (encoding == SEATMAP_RLE) {
+    for (size_t i = 0; i < num_seats;) {
+      size_t j = i + 1;
+      while (j < num_seats && seats[j] == seats[i]) {
+        j++;
+      }
+      pos += put_varint(out + pos, (uint32_t)(j - i));
+      pos += put_varint(out + pos, seats[i]);
+      i = j;
+    }
+    return pos;
+  }
+
+  switch (width) {
+    case 1:
+      for (size_t i = 0; i < num_seats; i++) {
+        out[pos + i] = (char)seats[i];
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < num_seats; i++) {
+        uint16_t seat = (uint16_t)seats[i];
+        memcpy(out + pos + 2 * i, &seat, sizeof(seat));
+      }
+      break;
+    default:
+      memcpy(out + pos, seats, num_seats * sizeof(uint32_t));
+      break;
+  }
+  return pos + num_seats * width;
+}
+
+struct SharedSeatMap *shared_seatmap_create(const char *name, size_t rows, size_t cols) {
+  size_t num_seats = seat_count(rows, cols);
+  if (num_seats == 0 && rows != 0 && cols != 0) {
+    return NULL;
+  }
+  size_t size = sizeof(struct SharedSeatMap) + num_seats * sizeof(unsigned int);
+
+  // Só o utilizador do servidor (e os seus clientes) pode ler os lugares
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1) {
+    return NULL;
+  }
+  // ftruncate preenche o segmento com zeros, ou seja, lugares livres
+  if (ftruncate(fd, (off_t)size) == -1) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  struct SharedSeatMap *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  atomic_init(&map->seq, 0);
+  map->rows = rows;
+  map->cols = cols;
+  return map;
+}
+
+void shared_seatmap_destroy(const char *name, struct SharedSeatMap *map) {
+  munmap(map, sizeof(struct SharedSeatMap) + map->rows * map->cols * sizeof(unsigned int));
+  shm_unlink(name);
+}
+
+void shared_seatmap_write_begin(struct SharedSeatMap *map) {
+  uint64_t seq = atomic_load_explicit(&map->seq, memory_order_relaxed);
+  atomic_store_explicit(&map->seq, seq + 1, memory_order_relaxed);
+  // Os lugares só podem ser escritos depois de seq ficar ímpar
+  atomic_thread_fence(memory_order_release);
+}
+
+void shared_seatmap_write_end(struct SharedSeatMap *map) {
+  uint64_t seq = atomic_load_explicit(&map->seq, memory_order_relaxed);
+  atomic_store_explicit(&map->seq, seq + 1, memory_order_release);
+}
+
+size_t seatmap_encode_shared(char *out, size_t rows, size_t cols, const char *name) {
+  uint32_t dims[2] = {(uint32_t)rows, (uint32_t)cols};
+  out[0] = SEATMAP_VERSION;
+  out[1] = SEATMAP_SHM;
+  out[2] = 0;
+  memcpy(out + 3, dims, sizeof(dims));
+
+  size_t len = strnlen(name, SEATMAP_SHM_NAME_SIZE - 1);
+  memcpy(out + SEATMAP_HEADER_SIZE, name, len);
+  out[SEATMAP_HEADER_SIZE + len] = '\0';
+  return SEATMAP_HEADER_SIZE + len + 1;
+}
+
+/// Maps a shared seat map read-only, reusing the mapping of earlier calls.
+/// Keeps at most SEATMAP_MAX_MAPPINGS mappings, unmapping the least recently used.
+static const struct SharedSeatMap *open_shared(const char *name, size_t num_seats) {
+  for (struct SharedMapping **link = &mappings; *link != NULL; link = &(*link)->next) {
+    struct SharedMapping *mapping = *link;
+    if (strcmp(mapping->name, name) == 0) {
+      // Passa para a frente da lista
+      *link = mapping->next;
+      mapping->next = mappings;
+      mappings = mapping;
+      return mapping->map;
+    }
+  }
+
+  size_t size = sizeof(struct SharedSeatMap) + num_seats * sizeof(unsigned int);
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < size) {
+    close(fd);
+    return NULL;
+  }
+  const struct SharedSeatMap *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  struct SharedMapping *mapping = malloc(sizeof(struct SharedMapping));
+  if (mapping == NULL) {
+    munmap((void *)map, size);
+    return NULL;
+  }
+  strcpy(mapping->name, name);
+  mapping->map = map;
+  mapping->size = size;
+  mapping->next = mappings;
+  mappings = mapping;
+
+  if (++num_mappings > SEATMAP_MAX_MAPPINGS) {
+    struct SharedMapping **last = &mappings;
+    while ((*last)->next != NULL) {
+      last = &(*last)->next;
+    }
+    munmap((void *)(*last)->map, (*last)->size);
+    free(*last);
+    *last = NULL;
+    num_mappings--;
+  }
+  return map;
+}
+
+void seatmap_release_shared(void) {
+  while (mappings != NULL) {
+    struct SharedMapping *next = mappings->next;
+    munmap((void *)mappings->map, mappings->size);
+    free(mappings);
+    mappings = next;
+  }
+  num_mappings = 0;
+}
+
+/// Copies the seats of a shared seat map, retrying while a write is in progress.
+static void read_shared(const struct SharedSeatMap *map, unsigned int *out, size_t num_seats) {
+  while (1) {
+    uint64_t before = atomic_load_explicit((_Atomic uint64_t *)&map->seq, memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(out, map->data, num_seats * sizeof(unsigned int));
+    // A cópia tem de terminar antes de se voltar a ler seq
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit((_Atomic uint64_t *)&map->seq, memory_order_relaxed) == before) {
+      return;
+    }
+  }
+}
+
+int seatmap_decode(const char *in, size_t size, size_t *rows, size_t *cols, unsigned int **seats) {
+  if (size < SEATMAP_HEADER_SIZE || in[0] != SEATMAP_VERSION) {
+    return 1;
+  }
+  unsigned char encoding = (unsigned char)in[1];
+  unsigned char width = (unsigned char)in[2];
+  uint32_t dims[2];
+  memcpy(dims, in + 3, sizeof(dims));
+
+  size_t num_seats = seat_count(dims[0], dims[1]);
+  if (num_seats == 0 && dims[0] != 0 && dims[1] != 0) {
+    return 1;
+  }
+
+  unsigned int *out = malloc(num_seats > 0 ? num_seats * sizeof(unsigned int) : 1);
+  if (out == NULL) {
+    return 1;
+  }
+  size_t pos = SEATMAP_HEADER_SIZE;
+
+  if (encoding == SEATMAP_RLE) {
+    size_t seat = 0;
+    while (seat < num_seats) {
+      uint32_t length, id;
+      if (get_varint(in, size, &pos, &length) || get_varint(in, size, &pos, &id) || length == 0 ||
+          length > num_seats - seat) {
+        free(out);
+        return 1;
+      }
+      for (uint32_t i = 0; i < length; i++) {
+        out[seat++] = id;
+      }
+    }
+  } else if (encoding == SEATMAP_RAW && (width == 1 || width == 2 || width == 4) &&
+             size - pos >= num_seats * width) {
+    switch (width) {
+      case 1:
+        for (size_t i = 0; i < num_seats; i++) {
+          out[i] = (unsigned char)in[pos + i];
+        }
+        break;
+      case 2:
+        for (size_t i = 0; i < num_seats; i++) {
+          uint16_t seat;
+          memcpy(&seat, in + pos + 2 * i, sizeof(seat));
+          out[i] = seat;
+        }
+        break;
+      default:
+        memcpy(out, in + pos, num_seats * sizeof(uint32_t));
+        break;
+    }
+  } else if (encoding == SEATMAP_SHM && size - pos >= 2 && size - pos <= SEATMAP_SHM_NAME_SIZE &&
+             in[size - 1] == '\0' && in[pos] == '/') {
+    const struct SharedSeatMap *map = open_shared(in + pos, num_seats);
+    if (map == NULL || map->rows != dims[0] || map->cols != dims[1]) {
+      free(out);
+      return 1;
+    }
+    read_shared(map, out, num_seats);
+  } else {
+    free(out);
+    return 1;
+  }
+
+  *rows = dims[0];
+  *cols = dims[1];
+  *seats = out;
+  return 0;
+}
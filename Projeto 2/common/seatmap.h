@@ -0,0 +1,84 @@
+#ifndef COMMON_SEATMAP_H
+#define COMMON_SEATMAP_H
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Formato do mapa de lugares enviado na resposta a SHOW:
+//   versão (1 byte), codificação (1 byte), largura (1 byte),
+//   linhas e colunas (uint32 cada), seguidos dos lugares.
+// SEATMAP_RAW: cada lugar com `largura` bytes (1, 2 ou 4), a menor que
+// chega para o maior id de reserva.
+// SEATMAP_RLE: pares (comprimento, id) em varints LEB128, um por cada
+// sequência de lugares iguais.
+// SEATMAP_SHM: o nome (terminado em '\0') de um segmento de memória
+// partilhada com uma struct SharedSeatMap, lido sem passar pela pipe.
+#define SEATMAP_VERSION 1
+#define SEATMAP_RAW 0
+#define SEATMAP_RLE 1
+#define SEATMAP_SHM 2
+#define SEATMAP_SHM_NAME_SIZE 32
+#define SEATMAP_MAX_MAPPINGS 16
+#define SEATMAP_HEADER_SIZE (3 + 2 * sizeof(unsigned int))
+
+/// Returns the largest size seatmap_encode can produce for the given venue.
+/// @param rows Number of rows of the venue.
+/// @param cols Number of columns of the venue.
+/// @return The size in bytes, or 0 if the venue is too large to be encoded.
+size_t seatmap_max_size(size_t rows, size_t cols);
+
+/// Encodes a seat map, using RLE when it at least halves the size.
+/// @param out Buffer with at least seatmap_max_size(rows, cols) bytes.
+/// @param rows Number of rows of the venue.
+/// @param cols Number of columns of the venue.
+/// @param seats Reservation id of each seat, row by row.
+/// @return The number of bytes written, or 0 if the venue is too large.
+size_t seatmap_encode(char *out, size_t rows, size_t cols, const unsigned int *seats);
+
+/// Seat map published by the server in a shared memory segment.
+struct SharedSeatMap {
+  _Atomic uint64_t seq;  // Seqlock: odd while a reservation is being written
+  uint64_t rows;
+  uint64_t cols;
+  unsigned int data[];   // Reservation id of each seat, row by row
+};
+
+/// Creates and maps a shared memory segment for a venue, with every seat free.
+/// @param name Name of the segment, as given to shm_open.
+/// @param rows Number of rows of the venue.
+/// @param cols Number of columns of the venue.
+/// @return The mapped seat map, or NULL on failure.
+struct SharedSeatMap *shared_seatmap_create(const char *name, size_t rows, size_t cols);
+
+/// Unmaps and removes a segment created with shared_seatmap_create.
+void shared_seatmap_destroy(const char *name, struct SharedSeatMap *map);
+
+/// Marks the start of a write to the seats. Writers must be serialized.
+void shared_seatmap_write_begin(struct SharedSeatMap *map);
+
+/// Marks the end of a write to the seats, publishing it to the readers.
+void shared_seatmap_write_end(struct SharedSeatMap *map);
+
+/// Encodes a reference to a shared seat map (SEATMAP_SHM).
+/// @param out Buffer with at least SEATMAP_HEADER_SIZE + SEATMAP_SHM_NAME_SIZE bytes.
+/// @param rows Number of rows of the venue.
+/// @param cols Number of columns of the venue.
+/// @param name Name of the segment.
+/// @return The number of bytes written.
+size_t seatmap_encode_shared(char *out, size_t rows, size_t cols, const char *name);
+
+/// Decodes a seat map written by seatmap_encode or seatmap_encode_shared.
+/// Shared seat maps are mapped once, up to SEATMAP_MAX_MAPPINGS at a time, and
+/// then read as a consistent snapshot.
+/// @param in Encoded seat map.
+/// @param size Size of the encoded seat map.
+/// @param rows Pointer to store the number of rows in.
+/// @param cols Pointer to store the number of columns in.
+/// @param seats Pointer to store the seats in, allocated with malloc.
+/// @return 0 if the seat map was decoded successfully, 1 otherwise.
+int seatmap_decode(const char *in, size_t size, size_t *rows, size_t *cols, unsigned int **seats);
+
+/// Unmaps every shared seat map mapped by seatmap_decode.
+void seatmap_release_shared(void);
+
+#endif  // COMMON_SEATMAP_H
@@ -1,66 +1,125 @@
+#include "buffer_prod_cons.h"
+
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <pthread.h>
 
-#include "common/io.h"
-#include "eventlist.h"
-#include "operations.h"
+#include "stats.h"
 
-struct Session *head;
-struct Session *tail;
-int lenght = 0;
+int buffer_init(struct RegistrationBuffer *buffer) {
+  for (size_t i = 0; i < MAX_WAIT_LIST; i++) {
+    atomic_init(&buffer->slots[i].seq, i);
+  }
+  atomic_init(&buffer->enqueue_pos, 0);
+  atomic_init(&buffer->dequeue_pos, 0);
+  atomic_init(&buffer->producer_waiting, 0);
 
-int addNode(char *buffer) {
-    struct Session *new_session = malloc(sizeof(struct Session));
-    if (new_session == NULL) {
-        fprintf(stderr, "Failed to allocate memory\n");
-        return 1;
-    }
-    
-    memcpy(new_session->req_pipe_path, &buffer[1], 40);
-    memcpy(new_session->resp_pipe_path, &buffer[41], 40);
-    new_session->next = NULL;
-    if((head) == NULL) {
-        (head) = new_session;
-        tail = new_session;
-    }
-    else {
-        (tail)->next = new_session;
-        (tail) = new_session;
+  buffer->space_fd = eventfd(0, EFD_NONBLOCK);
+  if (buffer->space_fd == -1) {
+    fprintf(stderr, "[ERR]: eventfd failed: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+void buffer_destroy(struct RegistrationBuffer *buffer) { close(buffer->space_fd); }
+
+int buffer_push(struct RegistrationBuffer *buffer, const char *request) {
+  size_t pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+  struct Registration *slot;
+  while (1) {
+    slot = &buffer->slots[pos & (MAX_WAIT_LIST - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    // O slot está livre para esta posição: tenta ficar com ela
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&buffer->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Ainda tem o pedido de há MAX_WAIT_LIST posições
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
     }
-    lenght++;
+  }
 
-    return 0;
+  memcpy(slot->req_pipe_path, &request[1], 40);
+  memcpy(slot->resp_pipe_path, &request[41], 40);
+  slot->queued_ns = stats_now();
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+  return 0;
 }
 
-void removeFirstNode(struct Session *session) {
-    strcpy(session->req_pipe_path,head->req_pipe_path);
-    strcpy(session->resp_pipe_path,head->resp_pipe_path);
-    if (head->next == NULL) {
-        free(head);
-        head = NULL;
-        tail = NULL;
+int buffer_pop(struct RegistrationBuffer *buffer, struct Session *session) {
+  size_t pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
+  struct Registration *slot;
+  while (1) {
+    slot = &buffer->slots[pos & (MAX_WAIT_LIST - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    // O slot tem o pedido desta posição: tenta ficar com ele
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&buffer->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
     }
-    else {
-      struct Session *temp = head;  // Guarda a referência para o primeiro nó
-      head = temp->next;        // Atualiza a cabeça para apontar para o próximo nó
-      free(temp);
+  }
+
+  memcpy(session->req_pipe_path, slot->req_pipe_path, 40);
+  memcpy(session->resp_pipe_path, slot->resp_pipe_path, 40);
+  atomic_store_explicit(&session->ready_ns, slot->queued_ns, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, pos + MAX_WAIT_LIST, memory_order_release);
+
+  // Par da barreira em buffer_wait_space: ou o produtor vê o slot livre, ou
+  // este consumidor vê que ele está à espera
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&buffer->producer_waiting, memory_order_relaxed) &&
+      atomic_exchange_explicit(&buffer->producer_waiting, 0, memory_order_relaxed)) {
+    uint64_t one = 1;
+    if (write(buffer->space_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+      fprintf(stderr, "[ERR]: write to eventfd failed: %s\n", strerror(errno));
     }
-    lenght--;
+  }
+  return 0;
 }
 
-int head_null() {
-    if (head == NULL) {
-        return 1;
-    }
+/// Whether the producer's next position is still taken. With a single producer
+/// the answer only changes from full to not full.
+static int buffer_full(struct RegistrationBuffer *buffer) {
+  size_t pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+  size_t seq = atomic_load_explicit(&buffer->slots[pos & (MAX_WAIT_LIST - 1)].seq, memory_order_acquire);
+  return seq != pos;
+}
+
+int buffer_wait_space(struct RegistrationBuffer *buffer) {
+  if (!buffer_full(buffer)) {
+    return 0;
+  }
+
+  atomic_store_explicit(&buffer->producer_waiting, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!buffer_full(buffer)) {
+    // Entretanto libertou-se um slot, não é preciso esperar
+    atomic_store_explicit(&buffer->producer_waiting, 0, memory_order_relaxed);
     return 0;
+  }
+  return 1;
 }
 
-int list_length() {
-    return lenght;
-}
\ No newline at end of file
+void buffer_clear_space(struct RegistrationBuffer *buffer) {
+  uint64_t value;
+  while (read(buffer->space_fd, &value, sizeof(value)) == -1 && errno == EINTR)
+    ;
+}
@@ -1,14 +1,60 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 
-int addNode(char *buffer);
+#include "common/constants.h"
+#include "operations.h"
 
-void removeFirstNode(struct Session *session);
+#define CACHE_LINE_SIZE 64
 
-int head_null();
+_Static_assert((MAX_WAIT_LIST & (MAX_WAIT_LIST - 1)) == 0, "MAX_WAIT_LIST must be a power of two");
 
-int list_length();
+// Pedido de início de sessão à espera de um worker
+struct Registration {
+  alignas(CACHE_LINE_SIZE) _Atomic size_t seq;  // Próxima posição que pode usar o slot
+  char req_pipe_path[40];
+  char resp_pipe_path[40];
+  uint64_t queued_ns;  // Quando o pedido chegou, para as estatísticas do SETUP
+};
+
+/// Bounded lock-free queue of session registrations (Vyukov's MPMC ring).
+/// Pushing never blocks: when the ring is full the producer asks to be
+/// notified through space_fd, an eventfd it can watch with epoll.
+struct RegistrationBuffer {
+  alignas(CACHE_LINE_SIZE) _Atomic size_t enqueue_pos;
+  alignas(CACHE_LINE_SIZE) _Atomic size_t dequeue_pos;
+  alignas(CACHE_LINE_SIZE) _Atomic int producer_waiting;  // O produtor espera por espaço
+  int space_fd;                                            // Legível quando um slot é libertado
+  struct Registration slots[MAX_WAIT_LIST];
+};
+
+/// Initializes an empty buffer.
+/// @return 0 if the buffer was initialized successfully, 1 otherwise.
+int buffer_init(struct RegistrationBuffer *buffer);
+
+/// Frees the resources of the buffer.
+void buffer_destroy(struct RegistrationBuffer *buffer);
+
+/// Adds a registration read from the server pipe.
+/// @param buffer Buffer to add to.
+/// @param request Registration request: opcode, request pipe path and response pipe path.
+/// @return 0 if the registration was added, 1 if the buffer is full.
+int buffer_push(struct RegistrationBuffer *buffer, const char *request);
+
+/// Removes the oldest registration, copying its pipe paths to the session.
+/// @return 0 if a registration was removed, 1 if the buffer is empty.
+int buffer_pop(struct RegistrationBuffer *buffer, struct Session *session);
+
+/// Checks whether the buffer is full and, if so, asks to be notified through
+/// space_fd when a slot is freed. Only called by the producer.
+/// @return 1 if the buffer is full, 0 if there is space.
+int buffer_wait_space(struct RegistrationBuffer *buffer);
+
+/// Consumes the notification written to space_fd.
+void buffer_clear_space(struct RegistrationBuffer *buffer);
 
 #endif  // BUFFER_H
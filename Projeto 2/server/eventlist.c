@@ -1,7 +1,113 @@
 #include "eventlist.h"
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define INDEX_INITIAL_CAPACITY 64
+#define IDS_INITIAL_CAPACITY 64
+
+static struct EventIndex* create_index(size_t capacity) {
+  struct EventIndex* index = (struct EventIndex*)malloc(sizeof(struct EventIndex));
+  if (!index) return NULL;
+
+  index->slots = calloc(capacity, sizeof(_Atomic(struct Event*)));
+  if (!index->slots) {
+    free(index);
+    return NULL;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&index->slots[i], NULL);
+  }
+  index->capacity = capacity;
+  index->count = 0;
+  index->retired = NULL;
+  return index;
+}
+
+static void free_index(struct EventIndex* index) {
+  while (index) {
+    struct EventIndex* retired = index->retired;
+    free(index->slots);
+    free(index);
+    index = retired;
+  }
+}
+
+/// Fibonacci hashing, spreads sequential ids over the table.
+static size_t hash_id(unsigned int event_id, size_t capacity) {
+  return (size_t)(((uint64_t)event_id * 11400714819323198485ULL) >> 32) & (capacity - 1);
+}
+
+static void index_insert(struct EventIndex* index, struct Event* event) {
+  size_t i = hash_id(event->id, index->capacity);
+  while (atomic_load_explicit(&index->slots[i], memory_order_relaxed) != NULL) {
+    i = (i + 1) & (index->capacity - 1);
+  }
+  // Publica o evento já inicializado para os leitores
+  atomic_store_explicit(&index->slots[i], event, memory_order_release);
+  index->count++;
+}
+
+/// Doubles the index and publishes the new table. The old one is kept alive
+/// until free_list, since lock-free readers may still be probing it.
+static struct EventIndex* grow_index(struct EventIndex* index) {
+  struct EventIndex* bigger = create_index(index->capacity * 2);
+  if (!bigger) return NULL;
+
+  for (size_t i = 0; i < index->capacity; i++) {
+    struct Event* event = atomic_load_explicit(&index->slots[i], memory_order_relaxed);
+    if (event) index_insert(bigger, event);
+  }
+  bigger->retired = index;
+  return bigger;
+}
+
+static struct EventIds* create_ids(size_t capacity) {
+  struct EventIds* ids = malloc(sizeof(struct EventIds) + capacity * sizeof(struct ListedEvent));
+  if (!ids) return NULL;
+
+  ids->capacity = capacity;
+  atomic_init(&ids->count, 0);
+  ids->retired = NULL;
+  return ids;
+}
+
+static void free_ids(struct EventIds* ids) {
+  while (ids) {
+    struct EventIds* retired = ids->retired;
+    free(ids);
+    ids = retired;
+  }
+}
+
+/// Makes room for one more id, copying the ids to a bigger array when full.
+/// The old array is kept until free_list, LIST may still be copying it.
+static int reserve_id(struct EventList* list) {
+  struct EventIds* ids = atomic_load_explicit(&list->ids, memory_order_relaxed);
+  size_t count = atomic_load_explicit(&ids->count, memory_order_relaxed);
+  if (count < ids->capacity) return 0;
+
+  struct EventIds* bigger = create_ids(ids->capacity * 2);
+  if (!bigger) return 1;
+  memcpy(bigger->ids, ids->ids, count * sizeof(struct ListedEvent));
+  atomic_init(&bigger->count, count);
+  bigger->retired = ids;
+  atomic_store_explicit(&list->ids, bigger, memory_order_release);
+  return 0;
+}
+
+/// Publishes a new event, after reserve_id.
+static void publish_id(struct EventList* list, struct Event* event) {
+  struct EventIds* ids = atomic_load_explicit(&list->ids, memory_order_relaxed);
+  size_t count = atomic_load_explicit(&ids->count, memory_order_relaxed);
+
+  ids->ids[count].created = event->created;
+  ids->ids[count].id = event->id;
+  // O id só fica visível depois de escrito
+  atomic_store_explicit(&ids->count, count + 1, memory_order_release);
+}
 
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
@@ -10,6 +116,21 @@ struct EventList* create_list() {
     free(list);
     return NULL;
   }
+  struct EventIndex* index = create_index(INDEX_INITIAL_CAPACITY);
+  if (!index) {
+    pthread_rwlock_destroy(&list->rwl);
+    free(list);
+    return NULL;
+  }
+  struct EventIds* ids = create_ids(IDS_INITIAL_CAPACITY);
+  if (!ids) {
+    free_index(index);
+    pthread_rwlock_destroy(&list->rwl);
+    free(list);
+    return NULL;
+  }
+  atomic_init(&list->index, index);
+  atomic_init(&list->ids, ids);
   list->head = NULL;
   list->tail = NULL;
   return list;
@@ -18,9 +139,23 @@ struct EventList* create_list() {
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  // Mantém o fator de carga abaixo de 1/2
+  if ((index->count + 1) * 2 > index->capacity) {
+    struct EventIndex* bigger = grow_index(index);
+    if (!bigger) return 1;
+    atomic_store_explicit(&list->index, bigger, memory_order_release);
+    index = bigger;
+  }
+
   struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
   if (!new_node) return 1;
 
+  if (reserve_id(list) != 0) {
+    free(new_node);
+    return 1;
+  }
+
   new_node->event = event;
   new_node->next = NULL;
 
@@ -32,12 +167,22 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  index_insert(index, event);
+  // Um id listado pode logo ser encontrado com get_event
+  publish_id(list, event);
   return 0;
 }
 
-static void free_event(struct Event* event) {
+void free_event(struct Event* event) {
   if (!event) return;
-  free(event->data);
+  if (event->shared) {
+    shared_seatmap_destroy(event->shm_name, event->shared);
+  } else if (!event->mapped) {
+    free(event->data);
+  }
+  if (!event->mapped) {
+    free(event->occupied);
+  }
   free(event);
 }
 
@@ -53,22 +198,78 @@ void free_list(struct EventList* list) {
     free(temp);
   }
 
+  free_index(atomic_load(&list->index));
+  free_ids(atomic_load(&list->ids));
   free(list);
 }
 
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  if (!list || !from || !to) return NULL;
-  struct ListNode* current = from;
+int list_event_ids(struct EventList** lists, size_t num_lists, char** out) {
+  struct EventIds* snapshots[num_lists];
+  size_t counts[num_lists];
+  size_t total = 0;
+  size_t end = 0;  // Maior ordem de criação + 1
 
-  while (1) {
-    if (current->event->id == event_id) {
-      return current->event;
+  // Os primeiros count eventos de cada array já não mudam, mesmo que
+  // entretanto seja publicado um maior
+  for (size_t i = 0; i < num_lists; i++) {
+    snapshots[i] = atomic_load_explicit(&lists[i]->ids, memory_order_acquire);
+    counts[i] = atomic_load_explicit(&snapshots[i]->count, memory_order_acquire);
+    total += counts[i];
+    // Cada lista está por ordem de criação, o último é o mais recente
+    if (counts[i] > 0 && snapshots[i]->ids[counts[i] - 1].created + 1 > end) {
+      end = snapshots[i]->ids[counts[i] - 1].created + 1;
     }
+  }
+
+  *out = malloc(sizeof(size_t) + total * sizeof(unsigned int));
+  if (*out == NULL) return 1;
+  memcpy(*out, &total, sizeof(size_t));
+  if (total == 0) return 0;
 
-    if (current == to) {
+  // As ordens de criação são quase contíguas: cada evento vai diretamente
+  // para a sua posição, sem comparações entre listas
+  unsigned int* by_order = malloc(end * sizeof(unsigned int));
+  unsigned char* present = calloc(end, 1);
+  if (by_order == NULL || present == NULL) {
+    free(by_order);
+    free(present);
+    free(*out);
+    return 1;
+  }
+  for (size_t i = 0; i < num_lists; i++) {
+    for (size_t j = 0; j < counts[i]; j++) {
+      by_order[snapshots[i]->ids[j].created] = snapshots[i]->ids[j].id;
+      present[snapshots[i]->ids[j].created] = 1;
+    }
+  }
+
+  size_t n = 0;
+  for (size_t created = 0; created < end; created++) {
+    if (present[created]) {
+      memcpy(*out + sizeof(size_t) + n * sizeof(unsigned int), &by_order[created], sizeof(unsigned int));
+      n++;
+    }
+  }
+  free(by_order);
+  free(present);
+  return 0;
+}
+
+struct Event* get_event(struct EventList* list, unsigned int event_id) {
+  if (!list) return NULL;
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_acquire);
+
+  size_t i = hash_id(event_id, index->capacity);
+  while (1) {
+    struct Event* event = atomic_load_explicit(&index->slots[i], memory_order_acquire);
+    if (event == NULL) {
       return NULL;
     }
 
-    current = current->next;
+    if (event->id == event_id) {
+      return event;
+    }
+
+    i = (i + 1) & (index->capacity - 1);
   }
 }
@@ -2,52 +2,103 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "common/seatmap.h"
 
 struct Event {
   unsigned int id;            /// Event id
   unsigned int reservations;  /// Number of reservations for the event.
+  size_t created;             /// Creation order, across every list.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
   unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
+  uint64_t* occupied;     /// Bitmap of rows * cols bits, set for each reserved seat.
   pthread_mutex_t mutex;  // Mutex to protect the event
+
+  struct SharedSeatMap* shared;          /// Shared memory segment holding data, NULL if not shared.
+  char shm_name[SEATMAP_SHM_NAME_SIZE];  /// Name of the shared memory segment.
+  int mapped;                            /// data and occupied are in a mapped snapshot, not freed here.
 };
 
+/// Number of 64 bit words of the occupancy bitmap of an event with the given seats.
+#define OCCUPIED_WORDS(seats) (((seats) + 63) / 64)
+
 struct ListNode {
   struct Event* event;
   struct ListNode* next;
 };
 
+// Open addressing hash table indexing the events by id
+struct EventIndex {
+  size_t capacity;                // Number of slots (power of two)
+  size_t count;                   // Number of occupied slots
+  _Atomic(struct Event*)* slots;  // Slots, NULL when empty
+  struct EventIndex* retired;     // Previous (smaller) table, freed with the list
+};
+
+// Event published for LIST
+struct ListedEvent {
+  size_t created;   // Creation order of the event
+  unsigned int id;  // Event id
+};
+
+// Events in creation order, read by LIST without locks. The first count
+// entries never change; a full array is replaced by a bigger copy.
+struct EventIds {
+  size_t capacity;              // Number of entries that fit in the array
+  _Atomic size_t count;         // Number of published entries
+  struct EventIds* retired;     // Previous (smaller) array, freed with the list
+  struct ListedEvent ids[];     // Published events
+};
+
 // Linked list structure
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+  struct ListNode* head;               // Head of the list
+  struct ListNode* tail;               // Tail of the list
+  _Atomic(struct EventIndex*) index;   // Hash index by event id
+  _Atomic(struct EventIds*) ids;       // Published event ids
+  pthread_rwlock_t rwl;                // Mutex to protect the list
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list and indexes it by id.
+/// @note Appends must be serialized by the caller; lookups may run concurrently.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
+/// Frees an event and its seats, removing its shared memory segment if any.
+/// @param event Event to be freed.
+void free_event(struct Event* event);
+
 /// Removes a node from the list.
 /// @param list Event list to be modified.
 /// @return 0 if the node was removed successfully, 1 otherwise.
 void free_list(struct EventList* list);
 
+/// Copies the ids of the events in several lists, merged in creation order.
+/// @note Does not require any lock, even with a concurrent append.
+/// @param lists Event lists to be read.
+/// @param num_lists Number of lists.
+/// @param ids Pointer to store the ids in, allocated with malloc after a size_t
+/// holding their number (the layout of the LIST response).
+/// @return 0 if the ids were copied successfully, 1 otherwise.
+int list_event_ids(struct EventList** lists, size_t num_lists, char** ids);
+
 /// Retrieves an event in the list.
+/// @note Does not require any lock, even with a concurrent append.
 /// @param list Event list to be searched
 /// @param event_id Event id.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
+struct Event* get_event(struct EventList* list, unsigned int event_id);
 
 #endif  // SERVER_EVENT_LIST_H
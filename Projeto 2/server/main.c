@@ -9,24 +9,66 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/epoll.h>
 
 #include "common/constants.h"
 #include "common/io.h"
 #include "operations.h"
 #include "buffer_prod_cons.h"
+#include "pool.h"
 
 int initialized_server = 0;
 int signal_flag = 0;
+int terminate_flag = 0;
 
 int main(int argc, char* argv[]) {
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  // -s, -n e -l podem aparecer em qualquer posição, os restantes argumentos são posicionais
+  int shared_seats = 0;
+  unsigned long num_shards = EVENT_SHARDS;
+  const char* log_path = NULL;
+  char* endptr;
+  for (int i = 1; i < argc;) {
+    int consumed = 0;
+    if (strcmp(argv[i], "-s") == 0) {
+      shared_seats = 1;
+      consumed = 1;
+    } else if (strcmp(argv[i], "-n") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing number of shards\n");
+        return 1;
+      }
+      num_shards = strtoul(argv[i + 1], &endptr, 10);
+      if (*endptr != '\0' || num_shards < 1 || num_shards > MAX_EVENT_SHARDS) {
+        fprintf(stderr, "Invalid number of shards\n");
+        return 1;
+      }
+      consumed = 2;
+    } else if (strcmp(argv[i], "-l") == 0) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing log path\n");
+        return 1;
+      }
+      log_path = argv[i + 1];
+      consumed = 2;
+    }
+
+    if (consumed == 0) {
+      i++;
+      continue;
+    }
+    for (int j = i; j < argc - consumed; j++) {
+      argv[j] = argv[j + consumed];
+    }
+    argc -= consumed;
+  }
+
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "Usage: %s\n <pipe_path> [delay] [workers] [-s] [-n shards] [-l log]\n", argv[0]);
     return 1;
   }
 
-  char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
+  if (argc >= 3) {
     unsigned long int delay = strtoul(argv[2], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
@@ -37,7 +79,21 @@ int main(int argc, char* argv[]) {
     state_access_delay_us = (unsigned int)delay;
   }
 
-  if (ems_init(state_access_delay_us)) {
+  // Por omissão, um worker por core
+  long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (argc == 4) {
+    num_workers = strtol(argv[3], &endptr, 10);
+
+    if (*endptr != '\0' || num_workers < 1 || num_workers > MAX_WORKER_COUNT) {
+      fprintf(stderr, "Invalid number of workers\n");
+      return 1;
+    }
+  }
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+
+  if (ems_init(state_access_delay_us, shared_seats, num_shards, log_path)) {
     fprintf(stderr, "Failed to initialize EMS\n");
     return 1;
   }
@@ -59,8 +115,15 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  // Open server pipe for reading and writing
-  int server_fd = open(argv[1], O_RDWR);
+  // Os segmentos partilhados sobrevivem ao processo, têm de ser removidos à saída
+  if (shared_seats && (signal(SIGINT, sigterm_signal_handler) == SIG_ERR ||
+                       signal(SIGTERM, sigterm_signal_handler) == SIG_ERR)) {
+    perror("Signal handler failed\n");
+    return 1;
+  }
+
+  // Open server pipe for reading and writing, without blocking the event loop
+  int server_fd = open(argv[1], O_RDWR | O_NONBLOCK);
   if (server_fd == -1) {
     fprintf(stderr, "[ERR]: open server pipe failed: %s\n", strerror(errno));
     ems_terminate();
@@ -70,36 +133,50 @@ int main(int argc, char* argv[]) {
   char buffer[MAX_SIZE_PATHS]; // MAX SIZE OF 2 PATHS
   ssize_t bytesRead;
 
-  pthread_t threads[MAX_SESSION_COUNT];
-  struct ThreadArgs threadArgs[MAX_SESSION_COUNT];
-  pthread_mutex_t mutex;
-  pthread_cond_t cond_var; 
-  pthread_mutex_t mutex_cond;
-  pthread_rwlock_t buffer_lock;
+  pthread_t *threads = malloc((size_t)num_workers * sizeof(pthread_t));
+  struct ThreadArgs *threadArgs = malloc((size_t)num_workers * sizeof(struct ThreadArgs));
+  if (threads == NULL || threadArgs == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+  struct Pool pool;
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  struct RegistrationBuffer registrations;
 
-  if (pthread_cond_init(&cond_var,NULL) != 0) {
-    fprintf(stderr, "Error inicializing condition variable\n");
+  if (buffer_init(&registrations)) {
+    fprintf(stderr, "Failed to initialize registration buffer\n");
     return 1;
   }
-  if (pthread_mutex_init(&mutex, NULL) != 0) {
-    fprintf(stderr, "Error inicializing mutex\n");
+
+  if (pool_init(&pool, (int)num_workers)) {
+    fprintf(stderr, "Failed to initialize worker pool\n");
     return 1;
   }
-  if(pthread_mutex_init(&mutex_cond, NULL) != 0) {
-    fprintf(stderr, "Error inicializing mutex condition\n");
+
+  // A pipe do servidor é identificada por data.ptr a NULL, as sessões pelo seu ponteiro
+  struct epoll_event server_event;
+  server_event.events = EPOLLIN;
+  server_event.data.ptr = NULL;
+  if (epoll_ctl(pool.epoll_fd, EPOLL_CTL_ADD, server_fd, &server_event) == -1) {
+    fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
     return 1;
   }
-  if(pthread_rwlock_init(&buffer_lock, NULL) != 0) {
-    fprintf(stderr, "Error inicializing read and write lock\n");
+
+  // Com o buffer cheio a pipe do servidor deixa de ser vigiada, até um worker
+  // libertar um slot e acordar o event loop pelo eventfd
+  struct epoll_event space_event;
+  space_event.events = EPOLLIN;
+  space_event.data.ptr = &registrations;
+  if (epoll_ctl(pool.epoll_fd, EPOLL_CTL_ADD, registrations.space_fd, &space_event) == -1) {
+    fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
     return 1;
   }
+  int accepting = 1;
 
-  for (int i = 0; i < MAX_SESSION_COUNT; ++i) {
-    threadArgs[i].mutex = &mutex;
-    threadArgs[i].id = i + 1;
-    threadArgs[i].cond_var = &cond_var;
-    threadArgs[i].mutex_cond = &mutex_cond;
-    threadArgs[i].buffer_lock = &buffer_lock;
+  for (int i = 0; i < num_workers; ++i) {
+    threadArgs[i].id = i;
+    threadArgs[i].pool = &pool;
+    threadArgs[i].registrations = &registrations;
 
     // Cria thread
     if (pthread_create(&threads[i], 0, execute_commands, (void *)&threadArgs[i]) != 0) {
@@ -119,81 +196,97 @@ int main(int argc, char* argv[]) {
       }
     }
 
-    //bloquear o servidor se já não houver espaço na lista de espera (buffer)
-    if (pthread_mutex_lock(&mutex_cond) != 0) {
-      fprintf(stderr, "Error locking condition mutex\n");
-      return 1;
-    }
-    while(list_length() >= MAX_WAIT_LIST) {
-      if (pthread_cond_wait(&cond_var, &mutex_cond) != 0) {
-        fprintf(stderr, "Error waiting for condition\n");
-        pthread_mutex_unlock(&mutex_cond);
-        return 1;
-      }
-    }
-    if (pthread_mutex_unlock(&mutex_cond) != 0) {
-      fprintf(stderr, "Error unlocking condition mutex\n");
-      return 1;
+    if (terminate_flag) {
+      // Os workers podem estar a meio de um pedido, por isso não se liberta o estado
+      ems_remove_shared();
+      close(server_fd);
+      return 0;
     }
 
-    //ler da pipe do servidor 
-    bytesRead = read(server_fd, buffer, sizeof(buffer));
- 
-    if (bytesRead == -1) {
+    int num_events = epoll_wait(pool.epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+    if (num_events == -1) {
       // Trata erro EINTR
-      if(errno != EINTR) {
-        fprintf(stderr, "[ERR]: read from server pipe failed: %s\n", strerror(errno));
-        if (close(server_fd) == -1) {
-          fprintf(stderr, "[ERR]: close server pipe failed: %s\n", strerror(errno));
-          return 1;
-        }
+      if (errno != EINTR) {
+        fprintf(stderr, "[ERR]: epoll_wait failed: %s\n", strerror(errno));
+        close(server_fd);
         ems_terminate();
         return 1;
       }
       continue;
     }
-    
-    //Sinalizar as threads que a lista já não está vazia
-    if(bytesRead > 0) {
-      if (pthread_rwlock_wrlock(&buffer_lock) != 0) {
-        fprintf(stderr, "Error locking buffer read and write lock\n");
-        return 1;
-      }
-      if (addNode(buffer)) {
-        fprintf(stderr, "Failed to add node\n");
-        return 1;
+
+    for (int i = 0; i < num_events; i++) {
+      // Um worker libertou um slot do buffer: volta a aceitar sessões
+      if (events[i].data.ptr == &registrations) {
+        buffer_clear_space(&registrations);
+        if (!accepting) {
+          server_event.events = EPOLLIN;
+          if (epoll_ctl(pool.epoll_fd, EPOLL_CTL_MOD, server_fd, &server_event) == -1) {
+            fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
+            return 1;
+          }
+          accepting = 1;
+        }
+        continue;
       }
-      if (pthread_rwlock_unlock(&buffer_lock) != 0) {
-        fprintf(stderr, "Error unlocking buffer read and write lock\n");
-        return 1;
+
+      // Pedido pendente numa sessão: vai para um worker
+      if (events[i].data.ptr != NULL) {
+        pool_push(&pool, (struct Session *)events[i].data.ptr);
+        continue;
       }
-      if (pthread_cond_signal(&cond_var) != 0) {
-        fprintf(stderr, "[ERR]: pthread_cond_signal failed\n");
-        return 1;
+
+      // Lê os pedidos de início de sessão até esvaziar a pipe do servidor
+      while (1) {
+        // Buffer cheio: os pedidos ficam na pipe, o event loop continua a servir as sessões
+        if (buffer_wait_space(&registrations)) {
+          server_event.events = 0;
+          if (epoll_ctl(pool.epoll_fd, EPOLL_CTL_MOD, server_fd, &server_event) == -1) {
+            fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
+            return 1;
+          }
+          accepting = 0;
+          break;
+        }
+
+        //ler da pipe do servidor
+        bytesRead = read(server_fd, buffer, sizeof(buffer));
+        if (bytesRead == -1) {
+          if (errno == EINTR) continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+          fprintf(stderr, "[ERR]: read from server pipe failed: %s\n", strerror(errno));
+          if (close(server_fd) == -1) {
+            fprintf(stderr, "[ERR]: close server pipe failed: %s\n", strerror(errno));
+            return 1;
+          }
+          ems_terminate();
+          return 1;
+        }
+        if (bytesRead == 0) {
+          break;
+        }
+
+        // O event loop é o único produtor, por isso o slot verificado acima continua livre
+        if (buffer_push(&registrations, buffer)) {
+          fprintf(stderr, "Failed to add registration\n");
+          return 1;
+        }
+        pool_add_registration(&pool);
       }
     }
   }
 
-  for (int i = 0; i < MAX_SESSION_COUNT; ++i) {
+  for (int i = 0; i < num_workers; ++i) {
     void *retorno;
     if(pthread_join(threads[i], &retorno) == 1) {
       return 1;
     }
   }
+  pool_destroy(&pool);
+  free(threads);
+  free(threadArgs);
   
-  if (pthread_mutex_destroy(&mutex) != 0 ) {
-    fprintf(stderr, "Error destroying mutex\n");
-    return 1;
-  }
-  if( pthread_cond_destroy(&cond_var) != 0) {
-    fprintf(stderr, "Error destroying condition variable\n");
-    return 1;
-  }
-
-  if (pthread_rwlock_destroy(&buffer_lock) != 0) {
-    fprintf(stderr, "Error destroying read and write lock\n");
-    return 1;
-  }
+  buffer_destroy(&registrations);
 
   //TODO: Close Server
   if (close(server_fd) == -1) {
@@ -207,4 +300,8 @@ int main(int argc, char* argv[]) {
 
 void sigusr1_signal_handler() {
   signal_flag = 1;
-}
\ No newline at end of file
+}
+
+void sigterm_signal_handler() {
+  terminate_flag = 1;
+}
@@ -6,30 +6,50 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <sys/mman.h>
 
 #include "common/io.h"
+#include "common/seatmap.h"
 #include "eventlist.h"
 #include "operations.h"
 #include "buffer_prod_cons.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "wal.h"
 #include "common/constants.h"
 
-static struct EventList* event_list = NULL;
+static struct EventList** shards = NULL;  // Eventos repartidos por id, cada parte com o seu lock
+static size_t num_shards = 0;
+static _Atomic size_t num_created = 0;     // Dá a ordem de criação entre partes, para o LIST
 static unsigned int state_access_delay_us = 0;
+static int shared_seats = 0;
+static struct Wal wal;
+static int logging = 0;  // As alterações são escritas no log, desligado durante a reposição
+static char* snapshot_path = NULL;
+static struct Snapshot snapshot;  // Última snapshot, mapeada enquanto houver eventos a usá-la
+static pthread_t snapshot_thread;
+static int snapshot_running = 0;
+static int snapshot_stop = 0;
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;  // Uma snapshot de cada vez
+static pthread_cond_t snapshot_cond = PTHREAD_COND_INITIALIZER;
 
 int end_flag = 1;
 
+/// Gets the shard that holds the event with the given ID.
+static struct EventList* shard_of(unsigned int event_id) { return shards[event_id % num_shards]; }
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
+static struct Event* get_event_with_delay(unsigned int event_id) {
   struct timespec delay = {0, state_access_delay_us * 1000};
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id, from, to);
+  return get_event(shard_of(event_id), event_id);
 }
 
 /// Gets the index of a seat.
@@ -40,259 +60,757 @@ static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
-int ems_init(unsigned int delay_us) {
-  if (event_list != NULL) {
+/// Locks the mutex of an event, counting the wait if another thread holds it.
+static int lock_event(struct Event* event) {
+  if (pthread_mutex_trylock(&event->mutex) == 0) {
+    return 0;
+  }
+  uint64_t start = stats_now();
+  int result = pthread_mutex_lock(&event->mutex);
+  stats_lock_wait(stats_now() - start);
+  return result;
+}
+
+/// Write locks a shard, counting the wait if other threads hold it.
+static int wrlock_shard(struct EventList* shard) {
+  if (pthread_rwlock_trywrlock(&shard->rwl) == 0) {
+    return 0;
+  }
+  uint64_t start = stats_now();
+  int result = pthread_rwlock_wrlock(&shard->rwl);
+  stats_lock_wait(stats_now() - start);
+  return result;
+}
+
+static int apply_record(const char* record, size_t size);
+static int restore_snapshot();
+static void* snapshot_loop(void* args);
+
+int ems_init(unsigned int delay_us, int shared, size_t num_lists, const char* log_path) {
+  if (shards != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
     return 1;
   }
+  if (num_lists == 0) {
+    fprintf(stderr, "Invalid number of shards\n");
+    return 1;
+  }
 
-  event_list = create_list();
+  shards = malloc(num_lists * sizeof(struct EventList*));
+  if (shards == NULL) {
+    return 1;
+  }
+  for (size_t i = 0; i < num_lists; i++) {
+    shards[i] = create_list();
+    if (shards[i] == NULL) {
+      while (i > 0) {
+        free_list(shards[--i]);
+      }
+      free(shards);
+      shards = NULL;
+      return 1;
+    }
+  }
+  num_shards = num_lists;
   state_access_delay_us = delay_us;
+  shared_seats = shared;
+
+  // Repõe o estado da última snapshot e do log que se lhe seguiu antes de aceitar pedidos
+  if (log_path != NULL) {
+    snapshot_path = malloc(strlen(log_path) + sizeof(".snap"));
+    if (snapshot_path == NULL) {
+      ems_terminate();
+      return 1;
+    }
+    sprintf(snapshot_path, "%s.snap", log_path);
+
+    if (restore_snapshot() != 0 || wal_open(&wal, log_path, snapshot.log_offset, apply_record) != 0) {
+      ems_terminate();
+      return 1;
+    }
+    logging = 1;
 
-  return event_list == NULL;
+    snapshot_stop = 0;
+    if (pthread_create(&snapshot_thread, NULL, snapshot_loop, NULL) != 0) {
+      fprintf(stderr, "Error creating snapshot thread\n");
+      ems_terminate();
+      return 1;
+    }
+    snapshot_running = 1;
+  }
+  return 0;
 }
 
 int ems_terminate() {
-  if (event_list == NULL) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  // Uma snapshot em curso ainda lê os eventos
+  if (snapshot_running) {
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot_stop = 1;
+    pthread_cond_signal(&snapshot_cond);
+    pthread_mutex_unlock(&snapshot_mutex);
+    pthread_join(snapshot_thread, NULL);
+    snapshot_running = 0;
+  }
+
+  for (size_t i = 0; i < num_shards; i++) {
+    // Espera que termine uma inserção em curso nesta parte
+    if (pthread_rwlock_wrlock(&shards[i]->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
+      return 1;
+    }
+    pthread_rwlock_unlock(&shards[i]->rwl);
+    free_list(shards[i]);
   }
+  free(shards);
+  shards = NULL;
 
-  free_list(event_list);
-  pthread_rwlock_unlock(&event_list->rwl);
+  if (logging) {
+    wal_close(&wal);
+    logging = 0;
+  }
+  snapshot_close(&snapshot);
+  free(snapshot_path);
+  snapshot_path = NULL;
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-
-  if (event_list == NULL) {
+int ems_remove_shared() {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  for (size_t i = 0; i < num_shards; i++) {
+    if (pthread_rwlock_rdlock(&shards[i]->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
+      return 1;
+    }
+    for (struct ListNode* node = shards[i]->head; node != NULL; node = node->next) {
+      if (node->event->shared) {
+        shm_unlink(node->event->shm_name);
+      }
+    }
+    pthread_rwlock_unlock(&shards[i]->rwl);
   }
+  return 0;
+}
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
-    fprintf(stderr, "Event already exists\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+/// Appends the creation of an event to the log.
+/// @return Number of the record, or 0 on failure.
+static uint64_t log_create(const struct Event* event) {
+  char type = WAL_CREATE;
+  struct iovec parts[] = {
+      {&type, 1},
+      {(void*)&event->id, sizeof(unsigned int)},
+      {(void*)&event->rows, sizeof(size_t)},
+      {(void*)&event->cols, sizeof(size_t)},
+  };
+  return wal_append(&wal, parts, 4);
+}
+
+/// Appends a reservation to the log.
+/// @return Number of the record, or 0 on failure.
+static uint64_t log_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, const size_t* xs,
+                            const size_t* ys) {
+  char type = WAL_RESERVE;
+  struct iovec parts[] = {
+      {&type, 1},
+      {&event_id, sizeof(unsigned int)},
+      {&reservation_id, sizeof(unsigned int)},
+      {&num_seats, sizeof(size_t)},
+      {(void*)xs, num_seats * sizeof(size_t)},
+      {(void*)ys, num_seats * sizeof(size_t)},
+  };
+  return wal_append(&wal, parts, 6);
+}
+
+/// Waits until a logged change is on disk. Callers still hold the lock of
+/// what they changed, so no other session sees the change before this.
+/// @note If the log fails, the record may or may not have reached the disk,
+/// so the request can be neither confirmed nor refused: the server stops and
+/// the state is rebuilt from the log on restart.
+/// @param lsn Number of its record, 0 if nothing was logged.
+static void commit(uint64_t lsn) {
+  if (lsn != 0 && wal_commit(&wal, lsn) != 0) {
+    fprintf(stderr, "Error writing to log, stopping the server\n");
+    exit(EXIT_FAILURE);
   }
+}
 
+/// Allocates an event, not yet in any shard.
+/// @param seats Seats of the event in a mapped snapshot, used in place, or
+/// NULL to start with every seat free.
+/// @param occupied Occupancy bitmap in the snapshot, if seats is not NULL.
+/// @return The event, or NULL on failure.
+static struct Event* new_event(unsigned int event_id, size_t num_rows, size_t num_cols, unsigned int* seats,
+                               uint64_t* occupied) {
   struct Event* event = malloc(sizeof(struct Event));
 
   if (event == NULL) {
     fprintf(stderr, "Error allocating memory for event\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+    return NULL;
   }
 
   event->id = event_id;
   event->rows = num_rows;
   event->cols = num_cols;
   event->reservations = 0;
+  event->shared = NULL;
+  event->data = NULL;
+  event->occupied = NULL;
+  event->mapped = 0;
   if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
     free(event);
-    return 1;
+    return NULL;
+  }
+
+  if (seats != NULL && !shared_seats) {
+    event->data = seats;
+    event->occupied = occupied;
+    event->mapped = 1;
+    return event;
   }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
 
-  if (event->data == NULL) {
+  if (shared_seats) {
+    // Os lugares vivem num segmento que os clientes mapeiam para o SHOW
+    snprintf(event->shm_name, sizeof(event->shm_name), "/ems-%d-%u", (int)getpid(), event_id);
+    event->shared = shared_seatmap_create(event->shm_name, num_rows, num_cols);
+    if (event->shared != NULL) {
+      event->data = event->shared->data;
+    }
+  } else {
+    event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
+  }
+  event->occupied = calloc(OCCUPIED_WORDS(num_rows * num_cols), sizeof(uint64_t));
+
+  if (event->data == NULL || event->occupied == NULL) {
     fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
+    pthread_mutex_destroy(&event->mutex);
+    free_event(event);
+    return NULL;
+  }
+
+  // O segmento partilhado tem de ter os lugares guardados
+  if (seats != NULL) {
+    memcpy(event->data, seats, num_rows * num_cols * sizeof(unsigned int));
+    memcpy(event->occupied, occupied, OCCUPIED_WORDS(num_rows * num_cols) * sizeof(uint64_t));
+  }
+  return event;
+}
+
+/// Adds a new event to its shard, or frees it if the id is taken. When
+/// logging, the event is only added once its creation is on disk.
+/// @return 0 if the event was added successfully, 1 otherwise.
+static int insert_event(struct Event* event) {
+  unsigned int event_id = event->id;
+
+  // O write lock, só da parte do evento, é mantido apenas durante a inserção
+  struct EventList* shard = shard_of(event_id);
+  if (wrlock_shard(shard) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    pthread_mutex_destroy(&event->mutex);
+    free_event(event);
+    return 1;
+  }
+
+  // Outra sessão pode ter criado o evento entretanto
+  if (get_event(shard, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    stats_conflict();
+    pthread_rwlock_unlock(&shard->rwl);
+    pthread_mutex_destroy(&event->mutex);
+    free_event(event);
     return 1;
   }
 
-  if (append_to_list(event_list, event) != 0) {
+  event->created = atomic_fetch_add(&num_created, 1);
+  // Registado e no disco antes de ficar visível: uma reserva do evento fica
+  // sempre depois no log, e nenhuma sessão vê um evento que se pode perder.
+  // Só as criações desta parte esperam pelo disco, as pesquisas não usam o lock
+  uint64_t lsn = 0;
+  if (logging && (lsn = log_create(event)) == 0) {
+    fprintf(stderr, "Error writing to log\n");
+    pthread_rwlock_unlock(&shard->rwl);
+    pthread_mutex_destroy(&event->mutex);
+    free_event(event);
+    return 1;
+  }
+  commit(lsn);
+  if (append_to_list(shard, event) != 0) {
     fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
+    // O evento já está no log, não se pode dizer ao cliente que não foi criado
+    if (lsn != 0) {
+      exit(EXIT_FAILURE);
+    }
+    pthread_rwlock_unlock(&shard->rwl);
+    pthread_mutex_destroy(&event->mutex);
+    free_event(event);
     return 1;
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  pthread_rwlock_unlock(&shard->rwl);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  
-  if (event_list == NULL) {
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  // A pesquisa no índice não precisa do lock da lista
+  if (get_event_with_delay(event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    stats_conflict();
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
-
+  struct Event* event = new_event(event_id, num_rows, num_cols, NULL, NULL);
   if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    return 1;
-  }
-
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
     return 1;
   }
+  return insert_event(event);
+}
 
+/// Claims the given seats of an event, all of them or none, and logs the
+/// reservation. The seats are only marked in the occupancy bitmap: sessions
+/// see them once publish_seats writes the reservation id.
+/// @note The caller holds the mutex of the event.
+/// @param lsn Pointer to store the number of the log record in, if logging.
+/// @param reservation_id Pointer to store the id of the reservation in.
+/// @return 0 if the seats were claimed successfully, 1 otherwise.
+static int claim_seats(struct Event* event, size_t num_seats, const size_t* xs, const size_t* ys, uint64_t* lsn,
+                       unsigned int* reservation_id) {
   for (size_t i = 0; i < num_seats; i++) {
     if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
       fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
       return 1;
     }
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
-
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
-
-      break;
+  // Verifica cada lugar diretamente no bitmap de ocupação
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t index = seat_index(event, xs[i], ys[i]);
+    if (event->occupied[index / 64] & ((uint64_t)1 << (index % 64))) {
+      fprintf(stderr, "Seat already reserved\n");
+      stats_conflict();
+      return 1;
     }
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  // Com o mutex do evento, as reservas ficam no log pela ordem dos seus ids
+  if (logging && (*lsn = log_reserve(event->id, event->reservations + 1, num_seats, xs, ys)) == 0) {
+    fprintf(stderr, "Error writing to log\n");
+    return 1;
+  }
 
+  *reservation_id = ++event->reservations;
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t index = seat_index(event, xs[i], ys[i]);
+    event->occupied[index / 64] |= (uint64_t)1 << (index % 64);
+  }
+  return 0;
+}
+
+/// Writes the id of a claimed reservation to its seats.
+/// @note The caller holds the mutex of the event.
+static void publish_seats(struct Event* event, size_t num_seats, const size_t* xs, const size_t* ys,
+                          unsigned int reservation_id) {
+  // Os clientes que leem o segmento partilhado repetem a leitura se apanharem esta escrita
+  if (event->shared) {
+    shared_seatmap_write_begin(event->shared);
+  }
   for (size_t i = 0; i < num_seats; i++) {
     event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
   }
+  if (event->shared) {
+    shared_seatmap_write_end(event->shared);
+  }
+}
+
+/// Reserves the given seats of an event, all of them or none. When logging,
+/// the seats are only shown once the reservation is on disk: the mutex of
+/// the event is kept while waiting, so SHOW and the snapshot never see it
+/// before. Reservations of other events still share the same disk write.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(struct Event* event, size_t num_seats, const size_t* xs, const size_t* ys) {
+  if (lock_event(event) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  uint64_t lsn = 0;
+  unsigned int reservation_id;
+  if (claim_seats(event, num_seats, xs, ys, &lsn, &reservation_id) != 0) {
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+  commit(lsn);
+  publish_seats(event, num_seats, xs, ys, reservation_id);
 
   pthread_mutex_unlock(&event->mutex);
   return 0;
 }
 
-int ems_show(char **message, unsigned int event_id) {
-  if (event_list == NULL) {
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  struct Event* event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
+  return reserve_seats(event, num_seats, xs, ys);
+}
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
+int ems_reserve_batch(size_t num_reservations, const struct Reservation* reservations, int* status) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+  if (num_reservations > MAX_BATCH_SIZE) {
+    fprintf(stderr, "Too many reservations in batch\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  // Cada evento é procurado uma só vez, mesmo que apareça em várias reservas
+  struct Event* events[MAX_BATCH_SIZE];
+  struct Event* locked[MAX_BATCH_SIZE];  // Eventos distintos do lote, por ordem de id
+  size_t num_locked = 0;
+  for (size_t i = 0; i < num_reservations; i++) {
+    size_t j = 0;
+    while (j < i && reservations[j].event_id != reservations[i].event_id) {
+      j++;
+    }
+    if (j < i) {
+      events[i] = events[j];
+      continue;
+    }
+
+    events[i] = get_event_with_delay(reservations[i].event_id);
+    if (events[i] != NULL) {
+      size_t k = num_locked++;
+      for (; k > 0 && locked[k - 1]->id > events[i]->id; k--) {
+        locked[k] = locked[k - 1];
+      }
+      locked[k] = events[i];
+    }
+  }
+
+  // Os mutexes são trancados por ordem de id, dois lotes nunca esperam um
+  // pelo outro em ciclo. Ficam trancados até o lote estar no disco
+  for (size_t k = 0; k < num_locked; k++) {
+    if (lock_event(locked[k]) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      while (k > 0) {
+        pthread_mutex_unlock(&locked[--k]->mutex);
+      }
+      return 1;
+    }
+  }
+
+  unsigned int reservation_ids[MAX_BATCH_SIZE];
+  uint64_t last_lsn = 0;
+  for (size_t i = 0; i < num_reservations; i++) {
+    if (events[i] == NULL) {
+      fprintf(stderr, "Event not found\n");
+      status[i] = 1;
+      continue;
+    }
+    uint64_t lsn = 0;
+    status[i] = claim_seats(events[i], reservations[i].num_seats, reservations[i].xs, reservations[i].ys, &lsn,
+                            &reservation_ids[i]);
+    if (lsn > last_lsn) {
+      last_lsn = lsn;
+    }
+  }
+
+  // Um só commit para o lote, cobre os registos de todas as reservas
+  commit(last_lsn);
+  for (size_t i = 0; i < num_reservations; i++) {
+    if (status[i] == 0) {
+      publish_seats(events[i], reservations[i].num_seats, reservations[i].xs, reservations[i].ys,
+                    reservation_ids[i]);
+    }
+  }
+
+  for (size_t k = 0; k < num_locked; k++) {
+    pthread_mutex_unlock(&locked[k]->mutex);
+  }
+  return 0;
+}
+
+/// Applies a record of the log to the state, while opening it.
+/// @return 0 if the record was applied successfully, 1 otherwise.
+static int apply_record(const char* record, size_t size) {
+  unsigned int event_id;
+  size_t offset = 1 + sizeof(unsigned int);
+  if (size < offset) {
     return 1;
   }
+  memcpy(&event_id, record + 1, sizeof(unsigned int));
 
-  char info[2 * sizeof(size_t) + (event->rows * event->cols) * sizeof(size_t)];
-  memcpy(&info, &event->rows, sizeof(size_t));
-  memcpy(&info[sizeof(size_t)], &event->cols, sizeof(size_t));
+  switch (record[0]) {
+    case WAL_CREATE: {
+      size_t num_rows, num_cols;
+      if (size != offset + 2 * sizeof(size_t)) {
+        return 1;
+      }
+      // Já está na snapshot
+      if (get_event(shard_of(event_id), event_id) != NULL) {
+        return 0;
+      }
+      memcpy(&num_rows, record + offset, sizeof(size_t));
+      memcpy(&num_cols, record + offset + sizeof(size_t), sizeof(size_t));
+      struct Event* event = new_event(event_id, num_rows, num_cols, NULL, NULL);
+      return event == NULL || insert_event(event);
+    }
+    case WAL_RESERVE: {
+      unsigned int reservation_id;
+      size_t num_seats;
+      if (size < offset + sizeof(unsigned int) + sizeof(size_t)) {
+        return 1;
+      }
+      memcpy(&reservation_id, record + offset, sizeof(unsigned int));
+      memcpy(&num_seats, record + offset + sizeof(unsigned int), sizeof(size_t));
+      offset += sizeof(unsigned int) + sizeof(size_t);
+      if (num_seats > MAX_RESERVATION_SIZE || size != offset + 2 * num_seats * sizeof(size_t)) {
+        return 1;
+      }
 
-  // Copy data to info
-  size_t data_index = 2 * sizeof(size_t);
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      // Copy string representation of data to info
-      memcpy(&info[data_index], &event->data[seat_index(event, i, j)], sizeof(size_t));
-      data_index += sizeof(size_t);
+      // Os lugares são copiados para arrays alinhados, o registo não está
+      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      memcpy(xs, record + offset, num_seats * sizeof(size_t));
+      memcpy(ys, record + offset + num_seats * sizeof(size_t), num_seats * sizeof(size_t));
+      struct Event* event = get_event(shard_of(event_id), event_id);
+      if (event == NULL) {
+        return 1;
+      }
+      // Os ids das reservas são sequenciais: as que já estão na snapshot são ignoradas
+      if (reservation_id <= event->reservations) {
+        return 0;
+      }
+      if (reservation_id != event->reservations + 1) {
+        return 1;
+      }
+      return reserve_seats(event, num_seats, xs, ys);
     }
+    default:
+      return 1;
   }
-  pthread_mutex_unlock(&event->mutex);
+}
 
-  *message = malloc(2 * sizeof(size_t) + (event->rows * event->cols) * sizeof(size_t));
-  if (message == NULL) {
-    fprintf(stderr, "Error allocating memory\n");
+/// Adds the events of the latest snapshot, in creation order. The seats
+/// stay in the mapped file, unless they must be in shared memory.
+/// @return 0 if the snapshot was restored successfully, 1 otherwise.
+static int restore_snapshot() {
+  if (snapshot_open(&snapshot, snapshot_path) != 0) {
     return 1;
   }
-  memcpy(*message, info, 2 * sizeof(size_t) + (event->rows * event->cols) * sizeof(size_t));
+
+  for (uint64_t i = 0; i < snapshot.num_events; i++) {
+    const struct SnapshotEvent* header;
+    unsigned int* seats;
+    uint64_t* occupied;
+    if (snapshot_next(&snapshot, &header, &seats, &occupied) != 0) {
+      fprintf(stderr, "Truncated snapshot %s\n", snapshot_path);
+      return 1;
+    }
+
+    struct Event* event = new_event(header->id, header->rows, header->cols, seats, occupied);
+    if (event == NULL) {
+      return 1;
+    }
+    event->reservations = header->reservations;
+    if (insert_event(event) != 0) {
+      return 1;
+    }
+  }
   return 0;
 }
 
-int ems_list_events(char **message) {
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
+int ems_snapshot() {
+  if (shards == NULL || !logging) {
+    fprintf(stderr, "EMS state must be initialized with a log\n");
     return 1;
   }
+  pthread_mutex_lock(&snapshot_mutex);
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  // Com as partes bloqueadas, nenhuma criação está no log sem estar na lista:
+  // tudo o que está no log até log_offset fica na snapshot
+  for (size_t i = 0; i < num_shards; i++) {
+    pthread_rwlock_rdlock(&shards[i]->rwl);
+  }
+  uint64_t log_offset;
+  wal_last(&wal, &log_offset);
+  char* ids;
+  int error = list_event_ids(shards, num_shards, &ids);
+  for (size_t i = 0; i < num_shards; i++) {
+    pthread_rwlock_unlock(&shards[i]->rwl);
+  }
+
+  struct SnapshotWriter writer;
+  if (error || snapshot_begin(&writer, snapshot_path) != 0) {
+    if (!error) {
+      free(ids);
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
     return 1;
   }
+  size_t num_events;
+  memcpy(&num_events, ids, sizeof(size_t));
+
+  // Cada evento é copiado com o seu mutex e escrito depois, as reservas só
+  // esperam pela cópia
+  unsigned int* seats = NULL;
+  uint64_t* occupied = NULL;
+  size_t capacity = 0;
+  for (size_t k = 0; k < num_events && !error; k++) {
+    unsigned int event_id;
+    memcpy(&event_id, ids + sizeof(size_t) + k * sizeof(unsigned int), sizeof(unsigned int));
+    struct Event* event = get_event(shard_of(event_id), event_id);
+    size_t num_seats = event->rows * event->cols;
+
+    if (num_seats > capacity) {
+      free(seats);
+      free(occupied);
+      capacity = num_seats;
+      seats = malloc(capacity * sizeof(unsigned int));
+      occupied = malloc(OCCUPIED_WORDS(capacity) * sizeof(uint64_t));
+      if (seats == NULL || occupied == NULL) {
+        error = 1;
+        break;
+      }
+    }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+    struct SnapshotEvent header = {event->id, 0, event->rows, event->cols};
+    pthread_mutex_lock(&event->mutex);
+    header.reservations = event->reservations;
+    memcpy(seats, event->data, num_seats * sizeof(unsigned int));
+    memcpy(occupied, event->occupied, OCCUPIED_WORDS(num_seats) * sizeof(uint64_t));
+    pthread_mutex_unlock(&event->mutex);
 
-  if (current == NULL) {
-    
-    size_t num = 0;
-    *message = malloc(sizeof(size_t));
-    if (message == NULL) {
-      fprintf(stderr, "Error allocating memory\n");
-      return 1;
+    error = snapshot_add(&writer, &header, seats, occupied);
+  }
+  free(seats);
+  free(occupied);
+  free(ids);
+
+  if (error) {
+    fprintf(stderr, "Error writing snapshot\n");
+    snapshot_abort(&writer);
+    pthread_mutex_unlock(&snapshot_mutex);
+    return 1;
+  }
+  // O que a snapshot contém tem de estar no log antes de ela substituir a anterior
+  commit(wal_last(&wal, NULL));
+  error = snapshot_finish(&writer, log_offset);
+  pthread_mutex_unlock(&snapshot_mutex);
+  return error;
+}
+
+/// Takes a snapshot every SNAPSHOT_INTERVAL_S seconds, if the log grew.
+static void* snapshot_loop(void* args) {
+  (void)args;
+
+  // Os sinais são tratados pela thread principal
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  uint64_t saved;
+  wal_last(&wal, &saved);
+
+  pthread_mutex_lock(&snapshot_mutex);
+  while (!snapshot_stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SNAPSHOT_INTERVAL_S;
+    while (!snapshot_stop && pthread_cond_timedwait(&snapshot_cond, &snapshot_mutex, &deadline) != ETIMEDOUT)
+      ;
+    if (snapshot_stop) {
+      break;
     }
-    memcpy(*message, &num, sizeof(size_t));
+    pthread_mutex_unlock(&snapshot_mutex);
 
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 0;
+    uint64_t size;
+    wal_last(&wal, &size);
+    if (size != saved && ems_snapshot() == 0) {
+      saved = size;
+    }
+    pthread_mutex_lock(&snapshot_mutex);
   }
-  
-  size_t data_index = 1;
-  *message = malloc(sizeof(size_t) + sizeof(unsigned int));
-  if (message == NULL) {
-      fprintf(stderr, "Error allocating memory\n");
-      return 1;
+  pthread_mutex_unlock(&snapshot_mutex);
+  return NULL;
+}
+
+int ems_show(char **message, size_t *size, unsigned int event_id) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
-  while (1) {
-    // Calcular o novo tamanho
-    size_t new_size = sizeof(size_t) + ((data_index) * sizeof(unsigned int));
-    
-    // Realocar o bloco de memória
-    void *temp = realloc(*message, new_size);
-    if (temp == NULL) {
+
+  struct Event* event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  // Com lugares partilhados só se envia o nome do segmento, sem lock
+  if (event->shared) {
+    *message = malloc(SEATMAP_HEADER_SIZE + SEATMAP_SHM_NAME_SIZE);
+    if (*message == NULL) {
       fprintf(stderr, "Error allocating memory\n");
-      free(*message);
-      pthread_rwlock_unlock(&event_list->rwl);
       return 1;
     }
-    *message = temp;
-    
-    // Copiar o novo ID
-    memcpy(*message + sizeof(size_t) + ((data_index - 1) * sizeof(unsigned int)), &((current->event)->id), sizeof(unsigned int));
+    *size = seatmap_encode_shared(*message, event->rows, event->cols, event->shm_name);
+    return 0;
+  }
 
-    if (current == to) {
-        break;
-    }
-    data_index++;
-    current = current->next;
+  // As dimensões não mudam, o buffer é alocado fora da secção crítica
+  size_t max_size = seatmap_max_size(event->rows, event->cols);
+  *message = max_size > 0 ? malloc(max_size) : NULL;
+  if (*message == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+
+  if (lock_event(event) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    free(*message);
+    return 1;
+  }
+  // O mapa é codificado diretamente a partir dos lugares do evento
+  *size = seatmap_encode(*message, event->rows, event->cols, event->data);
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_list_events(char **message) {
+  if (shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
-  memcpy(*message, &data_index, sizeof(size_t));
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  // Copia os ids publicados sem o lock da lista, não bloqueia nem é bloqueado por ems_create
+  if (list_event_ids(shards, num_shards, message) != 0) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
   return 0;
 }
 
@@ -301,7 +819,6 @@ int ems_setup(int session_id, struct Session *session) {
   int resp_fd = open(session->resp_pipe_path, O_WRONLY);
   if (resp_fd == -1) {
     fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-    ems_terminate();
     return 1;
   }
 
@@ -309,14 +826,22 @@ int ems_setup(int session_id, struct Session *session) {
   memcpy(session_id_str, &session_id, sizeof(int));
 
   // Return session_id to client
-  if (print_str(resp_fd, session_id_str)) {
+  if (print_msg(resp_fd, session_id_str, sizeof(int))) {
     fprintf(stderr, "Error writing in response pipe\n");
+    close(resp_fd);
     return 1;
   }
-  if (close(resp_fd) == -1) {
-    fprintf(stderr, "Error closing response pipe\n");
+
+  // As pipes ficam abertas até ao fim da sessão
+  int req_fd = open(session->req_pipe_path, O_RDONLY);
+  if (req_fd == -1) {
+    fprintf(stderr, "[ERR]: open request pipe failed: %s\n", strerror(errno));
+    close(resp_fd);
     return 1;
   }
+
+  session->req_fd = req_fd;
+  session->resp_fd = resp_fd;
   return 0;
 }
 
@@ -326,342 +851,478 @@ void parse_create(char buffer[MAX_SIZE_PATHS], unsigned int *event_id, size_t *n
   memcpy(num_cols, &buffer[1 + sizeof(unsigned int) + sizeof(size_t)], sizeof(size_t));
 }
 
+/// Sends the response to the request being answered, preceded by its id if
+/// the client tagged it.
+/// @return 0 if the response was sent successfully, 1 otherwise.
+static int send_response(struct Session *session, const char *response, size_t size) {
+  stats_response(response, size);
+  if (!session->tagged) {
+    return print_msg(session->resp_fd, response, size);
+  }
+
+  char *message = malloc(sizeof(unsigned int) + size);
+  if (message == NULL) {
+    return 1;
+  }
+  memcpy(message, &session->request_id, sizeof(unsigned int));
+  memcpy(message + sizeof(unsigned int), response, size);
+  int result = print_msg(session->resp_fd, message, sizeof(unsigned int) + size);
+  free(message);
+  return result;
+}
+
+/// Answers an EMS_RESERVE_BATCH request: the number of reservations, then for
+/// each one the event id, the number of seats and their rows and columns.
+/// The response holds the result followed by the status of each reservation.
+/// @return 0 if the request was answered, 1 if it is malformed or the response failed.
+static int handle_reserve_batch(struct Session *session, const char *buffer, size_t size) {
+  size_t num_reservations;
+  if (size < 1 + sizeof(size_t)) {
+    return 1;
+  }
+  memcpy(&num_reservations, &buffer[1], sizeof(size_t));
+  if (num_reservations == 0 || num_reservations > MAX_BATCH_SIZE) {
+    return 1;
+  }
+
+  // Os lugares são copiados para arrays alinhados, o pedido não está
+  struct Reservation reservations[MAX_BATCH_SIZE];
+  size_t xs[MAX_BATCH_SEATS], ys[MAX_BATCH_SEATS];
+  size_t offset = 1 + sizeof(size_t);
+  size_t used = 0;
+  for (size_t i = 0; i < num_reservations; i++) {
+    struct Reservation *reservation = &reservations[i];
+    if (size - offset < sizeof(unsigned int) + sizeof(size_t)) {
+      return 1;
+    }
+    memcpy(&reservation->event_id, &buffer[offset], sizeof(unsigned int));
+    memcpy(&reservation->num_seats, &buffer[offset + sizeof(unsigned int)], sizeof(size_t));
+    offset += sizeof(unsigned int) + sizeof(size_t);
+
+    size_t num_seats = reservation->num_seats;
+    if (num_seats > MAX_RESERVATION_SIZE || num_seats > MAX_BATCH_SEATS - used ||
+        size - offset < 2 * num_seats * sizeof(size_t)) {
+      return 1;
+    }
+    reservation->xs = &xs[used];
+    reservation->ys = &ys[used];
+    memcpy(reservation->xs, &buffer[offset], num_seats * sizeof(size_t));
+    memcpy(reservation->ys, &buffer[offset + num_seats * sizeof(size_t)], num_seats * sizeof(size_t));
+    offset += 2 * num_seats * sizeof(size_t);
+    used += num_seats;
+  }
+  if (offset != size) {
+    return 1;
+  }
+
+  int status[MAX_BATCH_SIZE];
+  int response_val = ems_reserve_batch(num_reservations, reservations, status);
+
+  char response[sizeof(int) + sizeof(size_t) + MAX_BATCH_SIZE * sizeof(int)];
+  size_t response_size = sizeof(int);
+  memcpy(response, &response_val, sizeof(int));
+  if (response_val == 0) {
+    memcpy(&response[sizeof(int)], &num_reservations, sizeof(size_t));
+    memcpy(&response[sizeof(int) + sizeof(size_t)], status, num_reservations * sizeof(int));
+    response_size += sizeof(size_t) + num_reservations * sizeof(int);
+  }
+
+  if (send_response(session, response, response_size)) {
+    fprintf(stderr, "Error writing in response pipe\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Maps a request to the operation its statistics are kept under.
+static enum StatsOp request_op(const char *buffer, size_t size) {
+  if (buffer[0] - '0' == EMS_TAGGED) {
+    if (size <= REQUEST_TAG_SIZE) {
+      return STATS_OPS;
+    }
+    buffer += REQUEST_TAG_SIZE;
+  }
+  switch (buffer[0] - '0') {
+    case EMS_CREATE:
+      return STATS_CREATE;
+    case EMS_RESERVE:
+      return STATS_RESERVE;
+    case EMS_RESERVE_BATCH:
+      return STATS_RESERVE_BATCH;
+    case EMS_SHOW:
+      return STATS_SHOW;
+    case EMS_LIST_EVENTS:
+      return STATS_LIST;
+    default:
+      return STATS_OPS;
+  }
+}
+
+/// Answers one request of the session.
+/// @return 0 if the session goes on, 1 if it ended.
+static int handle_request(struct Session *session, char *buffer, size_t size) {
+  int flag = 1;
+  unsigned int event_id;
+  size_t num_seats = 0;
+  size_t num_rows;
+  size_t num_cols;
+  char *list = NULL;
+  char *message_list = NULL;
+  int response_val_list;
+  size_t list_size_stats;
+  int OP_CODE = 0;
+
+  // Pedidos com id: o id volta na resposta, para o cliente ter vários pedidos em curso
+  session->tagged = 0;
+  if (buffer[0] - '0' == EMS_TAGGED) {
+    if (size <= REQUEST_TAG_SIZE || buffer[REQUEST_TAG_SIZE] - '0' == EMS_TAGGED) {
+      return 1;
+    }
+    session->tagged = 1;
+    memcpy(&session->request_id, &buffer[1], sizeof(unsigned int));
+    buffer += REQUEST_TAG_SIZE;
+    size -= REQUEST_TAG_SIZE;
+  }
+
+  OP_CODE = buffer[0] - '0';
+
+  switch(OP_CODE) {
+
+    case EMS_QUIT:
+      flag = 0;
+      break;
+
+    case EMS_CREATE:
+      if (size < 1 + sizeof(unsigned int) + 2 * sizeof(size_t)) {
+        flag = 0;
+        break;
+      }
+      // Obtém dados enviados pela request pipe
+      parse_create(buffer, &event_id, &num_rows, &num_cols);
+
+      // Chama ems_create() com os dados fornecidos
+      int response_val = ems_create(event_id, num_rows, num_cols);
+
+      // Retorna valor ao cliente pela response pipe
+      char response[sizeof(int)];
+      memcpy(&response, &response_val, sizeof(int));
+
+      if (send_response(session, response, sizeof(int))) {
+        fprintf(stderr, "Error writing in response pipe\n");
+        flag = 0;
+      }
+
+      break;
+
+    case EMS_RESERVE:
+      if (size < 1 + sizeof(unsigned int) + sizeof(size_t)) {
+        flag = 0;
+        break;
+      }
+      memcpy(&num_seats, &buffer[1 + sizeof(unsigned int)], sizeof(size_t));
+      if (num_seats > MAX_RESERVATION_SIZE ||
+          size != 1 + sizeof(unsigned int) + sizeof(size_t) + 2 * num_seats * sizeof(size_t)) {
+        flag = 0;
+        break;
+      }
+
+
+      // Obtém dados enviados pela request pipe
+      memcpy(&event_id, &buffer[1], sizeof(unsigned int));
+      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      memcpy(xs, &buffer[1 + sizeof(unsigned int) + sizeof(size_t)], num_seats * sizeof(size_t));
+      memcpy(ys, &buffer[1 + sizeof(unsigned int) + sizeof(size_t) + num_seats * sizeof(size_t)], num_seats * sizeof(size_t));
+
+      // Chama ems_reserve() com os dados fornecidos
+      response_val = ems_reserve(event_id, num_seats, xs, ys);
+
+      // Retorna valor ao cliente pela response pipe
+      memcpy(&response, &response_val, sizeof(int));
+      if (send_response(session, response, sizeof(int))) {
+        fprintf(stderr, "Error writing in response pipe\n");
+        flag = 0;
+      }
+      break;
+
+    case EMS_RESERVE_BATCH:
+      if (handle_reserve_batch(session, buffer, size)) {
+        flag = 0;
+      }
+      break;
+
+    case EMS_SHOW:
+      if (size < 1 + sizeof(unsigned int)) {
+        flag = 0;
+        break;
+      }
+      // Obtém dados enviados pela request pipe
+      memcpy(&event_id, &buffer[1], sizeof(unsigned int));
+      char *ptr = NULL;
+      int response_val_show;
+
+      // Chama ems_show() e preenche buffer com o mapa de lugares codificado
+      size_t map_size;
+      response_val_show = ems_show(&ptr, &map_size, event_id);
+      if(response_val_show) {
+        char erro[sizeof(int)];
+        memcpy(erro, &response_val_show, sizeof(int));
+
+        if (send_response(session, erro, sizeof(int))) {
+          fprintf(stderr, "Error writing in response pipe\n");
+          flag = 0;
+        }
+        break;
+      }
+
+      char *message = malloc(sizeof(int) + map_size);
+      if (message == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(ptr);
+        return 1;
+      }
+      memcpy(message, &response_val_show, sizeof(int));
+      memcpy(message + sizeof(int), ptr, map_size);
+      free(ptr);
+
+      // Retorna valor ao cliente pela response pipe
+      if (send_response(session, message, sizeof(int) + map_size)) {
+        fprintf(stderr, "Error writing in response pipe\n");
+        flag = 0;
+      }
+      free(message);
+
+      break;
+
+    case EMS_LIST_EVENTS:
+
+      response_val_list = ems_list_events(&list);
+      if(response_val_list) {
+        char erro[sizeof(int)];
+        memcpy(erro, &response_val_list, sizeof(int));
+
+        if (send_response(session, erro, sizeof(int))) {
+          fprintf(stderr, "Error writing in response pipe\n");
+          flag = 0;
+        }
+        break;
+      }
+
+      size_t num_events;
+      memcpy(&num_events, list, sizeof(size_t));
+
+      // Cria mensagem a ser passada ao cliente pela pipe
+      size_t list_size = sizeof(int) + sizeof(size_t) + num_events * sizeof(unsigned int);
+      message_list = malloc(list_size);
+      if (message_list == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return 1;
+      }
+      memcpy(message_list + sizeof(int), list, sizeof(size_t) + num_events * sizeof(unsigned int));
+      memcpy(message_list, &response_val_list, sizeof(int));
+
+      // Retorna valor ao cliente pela response pipe
+      if (send_response(session, message_list, list_size)) {
+        fprintf(stderr, "Error writing in response pipe\n");
+        flag = 0;
+      }
+      free(list);
+      free(message_list);
+      list = NULL;
+      message_list = NULL;
+      break;
+
+    case EMS_STATS:
+      if (stats_format(&list, &list_size_stats)) {
+        response_val_list = 1;
+        char erro[sizeof(int)];
+        memcpy(erro, &response_val_list, sizeof(int));
+        if (send_response(session, erro, sizeof(int))) {
+          fprintf(stderr, "Error writing in response pipe\n");
+          flag = 0;
+        }
+        break;
+      }
+
+      // Resposta: resultado, tamanho do texto e o texto da tabela
+      message_list = malloc(sizeof(int) + sizeof(size_t) + list_size_stats);
+      if (message_list == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(list);
+        return 1;
+      }
+      response_val_list = 0;
+      memcpy(message_list, &response_val_list, sizeof(int));
+      memcpy(message_list + sizeof(int), &list_size_stats, sizeof(size_t));
+      memcpy(message_list + sizeof(int) + sizeof(size_t), list, list_size_stats);
+      if (send_response(session, message_list, sizeof(int) + sizeof(size_t) + list_size_stats)) {
+        fprintf(stderr, "Error writing in response pipe\n");
+        flag = 0;
+      }
+      free(list);
+      free(message_list);
+      list = NULL;
+      message_list = NULL;
+      break;
+
+    default:
+      // Pedido inválido, termina a sessão
+      flag = 0;
+      break;
+  }
+
+  return !flag;
+}
+
+/// Reads whatever the client already wrote to the request pipe, without
+/// blocking, and answers every complete request.
+/// @return 0 if the session goes on, 1 if it ended.
+static int serve_session(struct Session *session) {
+  int eof = 0;
+  while (1) {
+    if (session->in_len == session->in_cap) {
+      size_t capacity = session->in_cap > 0 ? 2 * session->in_cap : 512;
+      char *in = realloc(session->in, capacity);
+      if (in == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return 1;
+      }
+      session->in = in;
+      session->in_cap = capacity;
+    }
+
+    ssize_t read_bytes = read(session->req_fd, session->in + session->in_len, session->in_cap - session->in_len);
+    if (read_bytes == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      fprintf(stderr, "[ERR]: read from request pipe failed: %s\n", strerror(errno));
+      return 1;
+    }
+    if (read_bytes == 0) {
+      eof = 1;
+      break;
+    }
+    session->in_len += (size_t)read_bytes;
+  }
+
+  // Cada pedido chega com o seu tamanho, um pedido incompleto fica à espera do resto
+  size_t offset = 0;
+  while (session->in_len - offset >= sizeof(size_t)) {
+    size_t size;
+    memcpy(&size, session->in + offset, sizeof(size_t));
+    if (size == 0 || size > MAX_REQUEST_SIZE) {
+      return 1;
+    }
+    if (session->in_len - offset - sizeof(size_t) < size) {
+      break;
+    }
+    char *request = session->in + offset + sizeof(size_t);
+    enum StatsOp op = request_op(request, size);
+    uint64_t start = stats_begin();
+    if (handle_request(session, request, size)) {
+      return 1;
+    }
+    stats_end(op, atomic_load_explicit(&session->ready_ns, memory_order_relaxed), start, sizeof(size_t) + size);
+    offset += sizeof(size_t) + size;
+  }
+  memmove(session->in, session->in + offset, session->in_len - offset);
+  session->in_len -= offset;
+
+  // Cliente fechou a pipe sem fazer quit
+  return eof;
+}
+
 void* execute_commands(void *args) {
   // Verifica sinal
   sigset_t mask;
   sigemptyset(&mask);
   sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
   if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
       perror("Blocking SIGUSR1 in thread failed");
       exit(EXIT_FAILURE);
   }
 
   struct ThreadArgs *threadArgs = (struct ThreadArgs *)args;
-  pthread_mutex_t *mutex_t = threadArgs->mutex;
-  int thread_id = threadArgs->id;
-  struct Session *session = malloc(sizeof(struct Session));
-  pthread_cond_t *cond_var = threadArgs->cond_var;
-  pthread_mutex_t *mutex_cond = threadArgs->mutex_cond;
-  pthread_rwlock_t *buffer_lock = threadArgs->buffer_lock;
-  
+  int worker = threadArgs->id;
+  struct Pool *pool = threadArgs->pool;
+  struct RegistrationBuffer *registrations = threadArgs->registrations;
+
   while (1) {
-    int flag = 1;
-    unsigned int event_id;
-    ssize_t bytesRead;
-    size_t num_seats = 0;
-    size_t num_rows;
-    size_t num_cols;
-    char *list = NULL;
-    char *message_list = NULL;
-    int response_val_list;
-    int resp_fd_list;
-    int OP_CODE = 0;
-    char buffer[82];
-
-    //bloqueia se o buffer estiver vazio
-    if (pthread_mutex_lock(mutex_cond) != 0) {
-      fprintf(stderr, "Error locking condition mutex\n");
-      return (void *)1;
-    }
-    if (pthread_rwlock_rdlock(buffer_lock) != 0) {
-      fprintf(stderr, "Error locking buffer lock\n");
-      return (void *)1;
-    }
-    while(head_null()) {
-      pthread_rwlock_unlock(buffer_lock);
-      if (pthread_cond_wait(cond_var, mutex_cond) != 0) {
-        fprintf(stderr, "Error waiting for condition\n");
-        pthread_mutex_unlock(mutex_cond);
+    // Bloqueia até haver um pedido pendente ou um novo início de sessão
+    struct Session *session = pool_wait(pool, worker);
+
+    if (session == NULL) {
+      session = malloc(sizeof(struct Session));
+      if (session == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
         return (void *)1;
       }
-      if (pthread_rwlock_rdlock(buffer_lock) != 0) {
-        fprintf(stderr, "Error locking read and write lock\n");
-        return (void *)1;
+
+      // A pool reservou um pedido para este worker, que já foi publicado no
+      // buffer; com vários consumidores a posição pode ter de ser disputada
+      while (buffer_pop(registrations, session)) {
+        sched_yield();
+      }
+
+      // Faz ems setup e entrega a sessão ao event loop
+      session->id = atomic_fetch_add(&pool->next_session_id, 1);
+      session->in = NULL;
+      session->in_len = 0;
+      session->in_cap = 0;
+      session->tagged = 0;
+      uint64_t start = stats_begin();
+      if (ems_setup(session->id, session)) {
+        free(session);
+        continue;
+      }
+      stats_end(STATS_SETUP, atomic_load_explicit(&session->ready_ns, memory_order_relaxed), start, 1 + 2 * 40);
+      if (pool_add_session(pool, session)) {
+        close(session->req_fd);
+        close(session->resp_fd);
+        free(session);
       }
+      continue;
     }
-    pthread_rwlock_unlock(buffer_lock);
-    pthread_mutex_unlock(mutex_cond);
-    
-    //extrair pedido de incio de sessão ao buffer
-    if( pthread_rwlock_wrlock(buffer_lock) != 0) {
-      fprintf(stderr, "Error locking read and write lock\n");
-      return (void *)1;
-    }
-    removeFirstNode(session);
-    pthread_rwlock_unlock(buffer_lock);
-   
-    if (pthread_cond_signal(cond_var) != 0) {
-      fprintf(stderr, "[ERR]: pthread_cond_signal failed\n");
-      return (void *)1;
-    }
-
-    // Faz ems setup
-    ems_setup(thread_id, session);
-
-    while(flag) {
-      // Open request pipe for reading
-      int req_fd = open(session->req_pipe_path, O_RDWR);
-      if (req_fd == -1) {
-        fprintf(stderr, "[ERR]: open request pipe failed: %s\n", strerror(errno));
-        ems_terminate();
-        return (void*)1;
-      }
-      //TODO: Read from pipe
-      bytesRead = read(req_fd, buffer, sizeof(buffer));
-      if (bytesRead == -1) {
-        fprintf(stderr, "[ERR]: read from request pipe failed: %s\n", strerror(errno));
-        close(req_fd);
-        ems_terminate();
-        return (void*)1;
-      }
-      if (close(req_fd) == -1) {
-        fprintf(stderr, "[ERR]: close request pipe failed: %s\n", strerror(errno));
-        ems_terminate();
-        return (void*)1;
-      }
-      OP_CODE = buffer[0] - '0';
-    
-      switch(OP_CODE) {
-        
-        case EMS_QUIT:
-          if (pthread_mutex_lock(mutex_t) != 0) {
-            fprintf(stderr, "Error locking mutex\n");
-            return (void *)1;
-          }
-          flag = 0;
-          pthread_mutex_unlock(mutex_t);
-          break;
-        
-        case EMS_CREATE:
-          if (pthread_mutex_lock(mutex_t) != 0) {
-            fprintf(stderr, "Error locking mutex\n");
-            return (void *)1;
-          }
-          // Obtém dados enviados pela request pipe
-          parse_create(buffer, &event_id, &num_rows, &num_cols);
-          
-          // Chama ems_create() com os dados fornecidos
-          int response_val = ems_create(event_id, num_rows, num_cols);
-
-          // Retorna valor ao cliente pela response pipe
-          int resp_fd = open(session->resp_pipe_path, O_WRONLY);
-          if (resp_fd == -1) {
-            fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-            pthread_mutex_unlock(mutex_t);
-            return (void*)1;
-          }
-          char response[sizeof(int)];
-          memcpy(&response, &response_val, sizeof(int));
-
-          if (print_str_size(resp_fd, response, sizeof(int))) {
-            fprintf(stderr, "Error writing in response pipe\n");
-            return (void *)1;
-          }
-          if (close(resp_fd) == -1) {
-            fprintf(stderr, "Error closing response pipe\n");
-            return (void *)1;
-          }
-          pthread_mutex_unlock(mutex_t);
-
-          break;
-
-        case EMS_RESERVE:
-          
-          if (pthread_mutex_lock(mutex_t) != 0) {
-            fprintf(stderr, "Error locking mutex\n");
-            return (void *)1;
-          }
-         
-          // Obtém dados enviados pela request pipe
-          memcpy(&event_id, &buffer[1], sizeof(unsigned int));
-          memcpy(&num_seats, &buffer[1 + sizeof(unsigned int)], sizeof(size_t));
-          size_t *xs = malloc(num_seats * sizeof(size_t));
-          if (xs == NULL) {
-            fprintf(stderr, "Error allocating memory\n");
-            return (void *)1;
-          }
-          size_t *ys = malloc(num_seats * sizeof(size_t));
-          if (ys == NULL) {
-            fprintf(stderr, "Error allocating memory\n");
-            return (void *)1;
-          }
-          memcpy(xs, &buffer[1 + sizeof(unsigned int) + sizeof(size_t)], num_seats * sizeof(size_t));
-          memcpy(ys, &buffer[1 + sizeof(unsigned int) + sizeof(size_t) + num_seats * sizeof(size_t)], num_seats * sizeof(size_t));
-
-          // Chama ems_reserve() com os dados fornecidos
-          response_val = ems_reserve(event_id, num_seats, xs, ys);
-
-          // Retorna valor ao cliente pela response pipe
-          resp_fd = open(session->resp_pipe_path, O_WRONLY);
-          if (resp_fd == -1) {
-            fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-            pthread_mutex_unlock(mutex_t);
-             return (void*)1;
-          }
-          memcpy(&response, &response_val, sizeof(int));
-          if (print_str_size(resp_fd, response, sizeof(int))) {
-            fprintf(stderr, "Error writing in response pipe\n");
-            return (void *)1;
-          }
-          if (close(resp_fd) == -1) {
-            fprintf(stderr, "Error closing response pipe\n");
-            return (void *)1;
-          }
-          pthread_mutex_unlock(mutex_t);
-          break;
-        
-        case EMS_SHOW:
-          if (pthread_mutex_lock(mutex_t) != 0) {
-            fprintf(stderr, "Error locking mutex\n");
-            return (void *)1;
-          }
-          // Obtém dados enviados pela request pipe
-          memcpy(&event_id, &buffer[1], sizeof(unsigned int));
-          char *ptr = NULL;
-          int response_val_show;
-          int resp_fd_show;
-
-          // Chama ems_show() e preenche buffer com resultado
-          response_val_show = ems_show(&ptr, event_id);
-          if(response_val_show) {
-            char erro[sizeof(int)];
-            memcpy(erro, &response_val_show, sizeof(int));
-
-            resp_fd_show = open(session->resp_pipe_path, O_WRONLY);
-            if (resp_fd_show == -1) {
-              fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-              pthread_mutex_unlock(mutex_t);
-               return (void*)1;
-            }
-            if (print_str_size(resp_fd_show, erro, sizeof(int))) {
-              fprintf(stderr, "Error writing in response pipe\n");
-              return (void*)1;
-            }
-            if (close(resp_fd_show) == -1) {
-              fprintf(stderr, "Error closing response pipe\n");
-              return (void*)1;
-            }
-            pthread_mutex_unlock(mutex_t);
-            break;
-          }
-
-          size_t rows, cols;
-          memcpy(&rows, ptr, sizeof(size_t));
-          memcpy(&cols, ptr + sizeof(size_t), sizeof(size_t));
-
-          char *message = malloc(sizeof(int) + 2 * sizeof(size_t) + (rows * cols) * sizeof(size_t));
-          if (message == NULL) {
-            fprintf(stderr, "Error allocating memory\n");
-            return (void*)1;
-          }
-          memcpy(message, &response_val_show, sizeof(int));
-          memcpy(message + sizeof(int), ptr, 2 * sizeof(size_t) + (rows * cols) * sizeof(size_t));
-          
-          // Retorna valor ao cliente pela response pipe
-          resp_fd_show = open(session->resp_pipe_path, O_WRONLY);
-          if (resp_fd_show == -1) {
-            fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-            pthread_mutex_unlock(mutex_t);
-             return (void*)1;
-          }
-          if (print_str_size(resp_fd_show, message, sizeof(int) + 2 * sizeof(size_t) + (rows * cols) * sizeof(size_t))) {
-            fprintf(stderr, "Error writing in response pipe\n");
-            return (void*)1;
-          }
-          if (close(resp_fd_show) == -1) {
-            fprintf(stderr, "Error closing response pipe\n");
-            return (void*)1;
-          }
-          free(message);
-          pthread_mutex_unlock(mutex_t);
-
-          break;
-        
-        case EMS_LIST_EVENTS:
-          if (pthread_mutex_lock(mutex_t) != 0) {
-            fprintf(stderr, "Error locking mutex\n");
-            return (void*)1;
-          }
-         
-          response_val_list = ems_list_events(&list);
-          if(response_val_list) {
-            char erro[sizeof(int)];
-            memcpy(erro, &response_val_list, sizeof(int));
-
-            resp_fd_list = open(session->resp_pipe_path, O_WRONLY);
-            if (resp_fd_list == -1) {
-              fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-              pthread_mutex_unlock(mutex_t);
-               return (void*)1;
-            }
-            if (print_str_size(resp_fd_list, erro, sizeof(int))) {
-              fprintf(stderr, "Error writing in response pipe\n");
-              return (void*)1;
-            }
-            
-            if(close(resp_fd_list) == -1) {
-              fprintf(stderr, "Error closing response pipe\n");
-              return (void*)1;
-            }
-            pthread_mutex_unlock(mutex_t);
-            break;
-          }
-
-          size_t num_events;
-          memcpy(&num_events, list, sizeof(size_t));
-          size_t size = 0;
-
-          // Cria mensagem a ser passada ao cliente pela pipe
-          size = sizeof(int) + sizeof(size_t) + num_events * sizeof(unsigned int);
-          if (num_events != 0) {
-            message_list = malloc(sizeof(int) + sizeof(size_t) + num_events * sizeof(unsigned int));
-            if (message_list == NULL) {
-              fprintf(stderr, "Error allocating memory\n");
-              return (void*)1;
-            }
-            memcpy(message_list + sizeof(int), list, sizeof(size_t) + num_events * sizeof(unsigned int));
-            memcpy(message_list, &response_val_list, sizeof(int));
-          }
-          
-          // Retorna valor ao cliente pela response pipe
-          resp_fd_list = open(session->resp_pipe_path, O_WRONLY);
-          if (resp_fd_list == -1) {
-            fprintf(stderr, "[ERR]: open response pipe failed: %s\n", strerror(errno));
-            pthread_mutex_unlock(mutex_t);
-             return (void*)1;
-          }
-          if (print_str_size(resp_fd_list, message_list, size)) {
-            fprintf(stderr, "Error writing in response pipe\n");
-            return (void*)1;
-          }
-          if(close(resp_fd_list) == -1) {
-            fprintf(stderr, "Error closing response pipe\n");
-            return (void*)1;
-          }
-          free(list);
-          free(message_list);
-          pthread_mutex_unlock(mutex_t);
-          break;
-      }
-    }
-  }
-   return (void*)0;
+
+    // Só trata os pedidos que já chegaram: a sessão volta ao event loop e o
+    // próximo pedido pode ser servido por qualquer worker
+    if (!serve_session(session) && !pool_release(pool, session)) {
+      continue;
+    }
+
+    pool_remove_session(pool, session);
+    if (close(session->req_fd) == -1 || close(session->resp_fd) == -1) {
+      fprintf(stderr, "Error closing session pipes\n");
+    }
+    free(session->in);
+    free(session);
+  }
+  return (void*)0;
 }
 
 
 
 int signal_show() {  
-  struct ListNode* event_node = event_list->head;
+  // Mostra os eventos pela ordem de criação, como o LIST
+  char *ids;
+  if (list_event_ids(shards, num_shards, &ids) != 0) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+  size_t num_events;
+  memcpy(&num_events, ids, sizeof(size_t));
 
-  if(event_node == NULL) {
+  if(num_events == 0) {
     printf("No Events\n");
+    free(ids);
     return 0;
   }
 
-  struct Event* event;
-
-  while (event_node != NULL) {
-    event = event_node->event;
+  for (size_t k = 0; k < num_events; k++) {
+    unsigned int event_id;
+    memcpy(&event_id, ids + sizeof(size_t) + k * sizeof(unsigned int), sizeof(unsigned int));
+    struct Event* event = get_event(shard_of(event_id), event_id);
     printf("Event id: %d\n", event->id);
     for (size_t i = 1; i <= event->rows; i++) {
       for (size_t j = 1; j <= event->cols; j++) {
@@ -672,7 +1333,7 @@ int signal_show() {
       }
       printf("\n");
     }
-    event_node = event_node->next;
   }
+  free(ids);
   return 0;
-}
\ No newline at end of file
+}
@@ -1,7 +1,9 @@
 #ifndef SERVER_OPERATIONS_H
 #define SERVER_OPERATIONS_H
 
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define EMS_SETUP 1
 #define EMS_QUIT 2
@@ -10,11 +12,32 @@
 #define EMS_SHOW 5
 #define EMS_LIST_EVENTS 6
 #define EOC 7
+#define EMS_RESERVE_BATCH 8
+#define EMS_TAGGED 9  // Request id followed by another request, echoed in the response
+#define EMS_STATS 0   // Latency and counters of each operation, as text
 
 struct Session {
     char req_pipe_path[40];
     char resp_pipe_path[40];
-    struct Session *next;
+    int req_fd;   // File descriptor of request pipe, open during the session
+    int resp_fd;  // File descriptor of response pipe, open during the session
+    int id;       // Session id sent to the client
+    char *in;     // Bytes read from the request pipe that do not make a whole request yet
+    size_t in_len;
+    size_t in_cap;
+    int tagged;                // The request being answered came with an id
+    unsigned int request_id;   // Id of the request being answered, if tagged
+    _Atomic uint64_t ready_ns; // When the event loop saw requests waiting, for the stats
+    struct Session *next;      // Toward the tail of the work deque holding it
+    struct Session *prev;      // Toward the head
+};
+
+/// One reservation of a batch.
+struct Reservation {
+    unsigned int event_id;
+    size_t num_seats;
+    size_t *xs;  // Rows of the seats
+    size_t *ys;  // Columns of the seats
 };
 
 struct Request {
@@ -22,24 +45,39 @@ struct Request {
     char resp_pipe_path[40];
 };
 
+struct Pool;
+struct RegistrationBuffer;
+
 struct ThreadArgs {
-    pthread_mutex_t *mutex;  // mutex para a leitura e gravação
-    pthread_mutex_t *mutex_cond;  // mutex para condition variable
-    pthread_rwlock_t *buffer_lock; // lock para escrita/leitura no buffer de pedido
-    int id; // session id
-    struct Session session;
-    struct Session *head;
-    pthread_cond_t *cond_var;
+    int id; // índice do worker na pool
+    struct Pool *pool; // pool de onde o worker tira pedidos
+    struct RegistrationBuffer *registrations; // pedidos de início de sessão
 };
 
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
+/// @param shared 1 to keep the seats of each event in shared memory, so that
+/// clients read SHOW results directly from it.
+/// @param num_shards Number of independent stores the events are split into by id.
+/// @param log_path Log to restore the state from and to record every change in,
+/// made durable before any session can see the change, or NULL to keep the state only in
+/// memory. If the log fails, the server stops.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
-int ems_init(unsigned int delay_us);
+int ems_init(unsigned int delay_us, int shared, size_t num_shards, const char* log_path);
 
 /// Destroys the EMS state.
 int ems_terminate();
 
+/// Saves every event to a snapshot next to the log, so that a restart only
+/// replays the log written after it. Reservations continue meanwhile.
+/// @note Also taken every SNAPSHOT_INTERVAL_S seconds while the log grows.
+/// @return 0 if the snapshot was saved successfully, 1 otherwise.
+int ems_snapshot();
+
+/// Removes the shared memory segments of the events, leaving the state as is.
+/// @return 0 if the segments were removed successfully, 1 otherwise.
+int ems_remove_shared();
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
@@ -55,17 +93,30 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
-/// Prints the given event.
-/// @param buffer Buffer to print the event to.
+/// Creates several independent reservations, looking up each event once.
+/// Each reservation is made in full or not at all, regardless of the others.
+/// @param num_reservations Number of reservations, at most MAX_BATCH_SIZE.
+/// @param reservations Reservations to create, in order.
+/// @param status Array to store 0 in for each reservation created, 1 otherwise.
+/// @return 0 if the batch was executed, 1 otherwise.
+int ems_reserve_batch(size_t num_reservations, const struct Reservation *reservations, int *status);
+
+/// Encodes the seat map of the given event (see common/seatmap.h).
+/// @param buffer Pointer to store the encoded seat map in, allocated with malloc.
+/// @param size Pointer to store the size of the encoded seat map in.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(char **buffer, unsigned int event_id);
+int ems_show(char **buffer, size_t *size, unsigned int event_id);
 
 /// Prints all the events.
 /// @param message File descriptor to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(char **message);
 
+/// Starts a session, opening the client pipes until the session ends.
+/// @param id Session id to send to the client.
+/// @param session Session whose pipes are opened.
+/// @return 0 if the session was started successfully, 1 otherwise.
 int ems_setup(int id, struct Session *session);
 
 void* execute_commands(void *args);
@@ -78,6 +129,8 @@ int parse_list(char **list, size_t *num_events, char **message_list, int *respon
 
 void sigusr1_signal_handler();
 
+void sigterm_signal_handler();
+
 int signal_show();
 
 #endif  // SERVER_OPERATIONS_H
@@ -0,0 +1,223 @@
+#include "pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "stats.h"
+
+int pool_init(struct Pool *pool, int num_workers) {
+  pool->queues = malloc((size_t)num_workers * sizeof(struct WorkQueue));
+  if (pool->queues == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+
+  for (int i = 0; i < num_workers; i++) {
+    pool->queues[i].head = NULL;
+    pool->queues[i].tail = NULL;
+    if (pthread_mutex_init(&pool->queues[i].mutex, NULL) != 0) {
+      fprintf(stderr, "Error initializing queue mutex\n");
+      return 1;
+    }
+  }
+  if (pthread_mutex_init(&pool->mutex, NULL) != 0 || pthread_cond_init(&pool->cond, NULL) != 0) {
+    fprintf(stderr, "Error initializing pool mutex\n");
+    return 1;
+  }
+
+  pool->epoll_fd = epoll_create1(0);
+  if (pool->epoll_fd == -1) {
+    fprintf(stderr, "[ERR]: epoll_create1 failed: %s\n", strerror(errno));
+    return 1;
+  }
+
+  pool->num_workers = num_workers;
+  pool->next_queue = 0;
+  atomic_init(&pool->pending, 0);
+  atomic_init(&pool->registrations, 0);
+  atomic_init(&pool->served_in_a_row, 0);
+  atomic_init(&pool->sleepers, 0);
+  atomic_init(&pool->next_session_id, 1);
+  return 0;
+}
+
+void pool_destroy(struct Pool *pool) {
+  for (int i = 0; i < pool->num_workers; i++) {
+    pthread_mutex_destroy(&pool->queues[i].mutex);
+  }
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->cond);
+  close(pool->epoll_fd);
+  free(pool->queues);
+}
+
+static void queue_push(struct WorkQueue *queue, struct Session *session) {
+  pthread_mutex_lock(&queue->mutex);
+  session->next = NULL;
+  session->prev = queue->tail;
+  if (queue->tail == NULL) {
+    queue->head = session;
+  } else {
+    queue->tail->next = session;
+  }
+  queue->tail = session;
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/// Takes the oldest session of a queue, used by its owner.
+static struct Session *queue_pop(struct WorkQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  struct Session *session = queue->head;
+  if (session != NULL) {
+    queue->head = session->next;
+    if (queue->head == NULL) {
+      queue->tail = NULL;
+    } else {
+      queue->head->prev = NULL;
+    }
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return session;
+}
+
+/// Takes the newest session of a queue, used by the other workers.
+static struct Session *queue_steal(struct WorkQueue *queue) {
+  // Sem bloquear: se a fila está ocupada, o ladrão passa à seguinte
+  if (pthread_mutex_trylock(&queue->mutex) != 0) {
+    return NULL;
+  }
+  struct Session *session = queue->tail;
+  if (session != NULL) {
+    queue->tail = session->prev;
+    if (queue->tail == NULL) {
+      queue->head = NULL;
+    } else {
+      queue->tail->next = NULL;
+    }
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return session;
+}
+
+/// Wakes a sleeping worker, if any. The count is read after the work was
+/// published, and a worker counts itself before checking for work, so one
+/// of the two always sees the other.
+static void wake_worker(struct Pool *pool) {
+  if (atomic_load(&pool->sleepers) > 0) {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+void pool_push(struct Pool *pool, struct Session *session) {
+  // O tempo na fila conta a partir daqui. Escrito pelo event loop, a ordem
+  // em relação ao worker vem do EPOLLONESHOT, que o sanitizer não vê
+  atomic_store_explicit(&session->ready_ns, stats_now(), memory_order_relaxed);
+  queue_push(&pool->queues[pool->next_queue], session);
+  pool->next_queue = (pool->next_queue + 1) % pool->num_workers;
+
+  // Só conta depois de estar numa fila: quem a reservar vai encontrá-la
+  atomic_fetch_add(&pool->pending, 1);
+  wake_worker(pool);
+}
+
+/// Reserves one unit of a counter, if it is not zero.
+/// @return 1 if a unit was reserved, 0 otherwise.
+static int take_one(_Atomic size_t *counter) {
+  size_t value = atomic_load(counter);
+  while (value > 0) {
+    if (atomic_compare_exchange_weak(counter, &value, value - 1)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Finds a session after one was reserved: first in the worker's own queue,
+/// then stealing from the others.
+static struct Session *take_session(struct Pool *pool, int worker) {
+  // Há pelo menos tantas sessões nas filas como reservas por satisfazer, mas
+  // uma passagem pode falhar a que chegou a uma fila já vista, daí o ciclo
+  while (1) {
+    struct Session *session = queue_pop(&pool->queues[worker]);
+    for (int i = 1; session == NULL && i < pool->num_workers; i++) {
+      session = queue_steal(&pool->queues[(worker + i) % pool->num_workers]);
+    }
+    if (session != NULL) {
+      return session;
+    }
+    sched_yield();
+  }
+}
+
+struct Session *pool_wait(struct Pool *pool, int worker) {
+  while (1) {
+    // Os pedidos de sessões já abertas passam à frente de novas sessões, mas
+    // só até um limite, para uma carga constante não impedir novos clientes
+    if (atomic_load(&pool->registrations) > 0 &&
+        (atomic_load(&pool->pending) == 0 || atomic_load(&pool->served_in_a_row) >= REQUESTS_PER_REGISTRATION) &&
+        take_one(&pool->registrations)) {
+      atomic_store(&pool->served_in_a_row, 0);
+      return NULL;
+    }
+    if (take_one(&pool->pending)) {
+      atomic_fetch_add(&pool->served_in_a_row, 1);
+      return take_session(pool, worker);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    atomic_fetch_add(&pool->sleepers, 1);
+    while (atomic_load(&pool->pending) == 0 && atomic_load(&pool->registrations) == 0) {
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    atomic_fetch_sub(&pool->sleepers, 1);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+void pool_add_registration(struct Pool *pool) {
+  atomic_fetch_add(&pool->registrations, 1);
+  wake_worker(pool);
+}
+
+int pool_add_session(struct Pool *pool, struct Session *session) {
+  int flags = fcntl(session->req_fd, F_GETFL);
+  if (flags == -1 || fcntl(session->req_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    fprintf(stderr, "[ERR]: fcntl on request pipe failed: %s\n", strerror(errno));
+    return 1;
+  }
+
+  // EPOLLONESHOT: a sessão só volta a ser vigiada quando o worker a devolve,
+  // por isso nunca está com dois workers ao mesmo tempo
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = session;
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, session->req_fd, &event) == -1) {
+    fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+void pool_remove_session(struct Pool *pool, struct Session *session) {
+  epoll_ctl(pool->epoll_fd, EPOLL_CTL_DEL, session->req_fd, NULL);
+}
+
+int pool_release(struct Pool *pool, struct Session *session) {
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = session;
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_MOD, session->req_fd, &event) == -1) {
+    fprintf(stderr, "[ERR]: epoll_ctl failed: %s\n", strerror(errno));
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "operations.h"
+
+/// Sessions with a pending request, waiting for a worker. The event loop
+/// adds at the tail, the owner takes the oldest from the head and other
+/// workers steal from the tail, each under the mutex of this deque only.
+struct WorkQueue {
+  struct Session *head;
+  struct Session *tail;
+  pthread_mutex_t mutex;
+};
+
+struct Pool {
+  int num_workers;
+  struct WorkQueue *queues;     // uma fila por worker
+  int next_queue;               // round robin, só usado pelo event loop
+  _Atomic size_t pending;       // sessões nas filas ainda não reservadas por um worker
+  _Atomic size_t registrations; // pedidos de início de sessão no buffer
+  _Atomic int served_in_a_row;  // pedidos servidos desde o último início de sessão
+  _Atomic int sleepers;         // workers a dormir, ou prestes a dormir, em cond
+  pthread_mutex_t mutex;        // só para dormir em cond
+  pthread_cond_t cond;          // workers esperam por trabalho
+  _Atomic int next_session_id;
+  int epoll_fd;                 // vigia a pipe do servidor e as pipes de pedidos
+};
+
+/// Initializes a pool with one work queue per worker.
+/// @param pool Pool to initialize.
+/// @param num_workers Number of worker threads that will serve the pool.
+/// @return 0 if the pool was initialized successfully, 1 otherwise.
+int pool_init(struct Pool *pool, int num_workers);
+
+/// Frees the resources of the pool.
+void pool_destroy(struct Pool *pool);
+
+/// Queues a session with a pending request. Only called by the event loop.
+void pool_push(struct Pool *pool, struct Session *session);
+
+/// Blocks until there is work for the worker, taking it from the worker's
+/// own queue or stealing it from another's. Requests of open sessions go
+/// first, but a waiting registration is served at least once every
+/// REQUESTS_PER_REGISTRATION requests.
+/// @param pool Pool to take work from.
+/// @param worker Index of the calling worker.
+/// @return A session with a pending request, or NULL if a registration was
+/// reserved and must be taken from the producer-consumer buffer.
+struct Session *pool_wait(struct Pool *pool, int worker);
+
+/// Signals the workers that a registration was added to the buffer.
+void pool_add_registration(struct Pool *pool);
+
+/// Makes the request pipe of a set up session non-blocking and starts
+/// watching it. The session belongs to the event loop from then on.
+/// @return 0 if the session was added successfully, 1 otherwise.
+int pool_add_session(struct Pool *pool, struct Session *session);
+
+/// Stops watching a session held by the caller.
+void pool_remove_session(struct Pool *pool, struct Session *session);
+
+/// Gives a session back to the event loop, to wait for its next request.
+/// @return 0 if the session was rearmed successfully, 1 otherwise.
+int pool_release(struct Pool *pool, struct Session *session);
+
+#endif  // SERVER_POOL_H
@@ -0,0 +1,192 @@
+#include "snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "eventlist.h"
+
+/// Size of the seats of an event, padded to keep the bitmap aligned.
+static size_t seats_size(uint64_t num_seats) { return (num_seats * sizeof(uint32_t) + 7) & ~(size_t)7; }
+
+/// Makes the entries of the directory holding a file durable, so that a
+/// rename of the file survives a crash.
+/// @return 0 if the directory was synced successfully, 1 otherwise.
+static int sync_parent_dir(const char *path) {
+  const char *slash = strrchr(path, '/');
+  char *dir = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : (size_t)(slash - path));
+  if (dir == NULL) {
+    return 1;
+  }
+
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  int error = fd == -1 || fsync(fd) != 0;
+  if (error) {
+    fprintf(stderr, "Error syncing directory %s: %s\n", dir, strerror(errno));
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  free(dir);
+  return error;
+}
+
+int snapshot_begin(struct SnapshotWriter *writer, const char *path) {
+  size_t len = strlen(path);
+  writer->path = malloc(len + 1);
+  writer->tmp_path = malloc(len + 5);
+  if (writer->path == NULL || writer->tmp_path == NULL) {
+    free(writer->path);
+    free(writer->tmp_path);
+    return 1;
+  }
+  strcpy(writer->path, path);
+  snprintf(writer->tmp_path, len + 5, "%s.tmp", path);
+
+  writer->file = fopen(writer->tmp_path, "w");
+  if (writer->file == NULL) {
+    fprintf(stderr, "Error creating snapshot %s: %s\n", writer->tmp_path, strerror(errno));
+    free(writer->path);
+    free(writer->tmp_path);
+    return 1;
+  }
+  writer->num_events = 0;
+
+  // O cabeçalho é reescrito no fim, quando se sabe o número de eventos
+  struct SnapshotHeader header = {SNAPSHOT_MAGIC, 0, 0};
+  if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+    snapshot_abort(writer);
+    return 1;
+  }
+  return 0;
+}
+
+int snapshot_add(struct SnapshotWriter *writer, const struct SnapshotEvent *event, const unsigned int *seats,
+                 const uint64_t *occupied) {
+  uint64_t num_seats = event->rows * event->cols;
+  static const char padding[8] = {0};
+  size_t padding_size = seats_size(num_seats) - num_seats * sizeof(uint32_t);
+
+  if (fwrite(event, sizeof(*event), 1, writer->file) != 1 ||
+      fwrite(seats, sizeof(uint32_t), num_seats, writer->file) != num_seats ||
+      fwrite(padding, 1, padding_size, writer->file) != padding_size ||
+      fwrite(occupied, sizeof(uint64_t), OCCUPIED_WORDS(num_seats), writer->file) != OCCUPIED_WORDS(num_seats)) {
+    return 1;
+  }
+  writer->num_events++;
+  return 0;
+}
+
+int snapshot_finish(struct SnapshotWriter *writer, uint64_t log_offset) {
+  struct SnapshotHeader header = {SNAPSHOT_MAGIC, writer->num_events, log_offset};
+
+  // Só substitui a snapshot anterior depois de estar toda em disco
+  if (fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1 ||
+      fflush(writer->file) != 0 || fsync(fileno(writer->file)) != 0) {
+    fprintf(stderr, "Error writing snapshot %s: %s\n", writer->tmp_path, strerror(errno));
+    snapshot_abort(writer);
+    return 1;
+  }
+  fclose(writer->file);
+
+  if (rename(writer->tmp_path, writer->path) != 0) {
+    fprintf(stderr, "Error renaming snapshot %s: %s\n", writer->tmp_path, strerror(errno));
+    unlink(writer->tmp_path);
+    free(writer->path);
+    free(writer->tmp_path);
+    return 1;
+  }
+  // Até o diretório estar no disco, uma falha pode desfazer a troca e o
+  // reinício partiria da snapshot anterior
+  int error = sync_parent_dir(writer->path);
+  free(writer->path);
+  free(writer->tmp_path);
+  return error;
+}
+
+void snapshot_abort(struct SnapshotWriter *writer) {
+  fclose(writer->file);
+  unlink(writer->tmp_path);
+  free(writer->path);
+  free(writer->tmp_path);
+}
+
+int snapshot_open(struct Snapshot *snapshot, const char *path) {
+  snapshot->map = NULL;
+  snapshot->size = 0;
+  snapshot->pos = sizeof(struct SnapshotHeader);
+  snapshot->num_events = 0;
+  snapshot->log_offset = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    fprintf(stderr, "Error opening snapshot %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct SnapshotHeader)) {
+    fprintf(stderr, "Invalid snapshot %s\n", path);
+    close(fd);
+    return 1;
+  }
+  // Privado: as reservas feitas depois escrevem numa cópia das páginas, não no ficheiro
+  char *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error mapping snapshot %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  struct SnapshotHeader header;
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "Invalid snapshot %s\n", path);
+    munmap(map, (size_t)st.st_size);
+    return 1;
+  }
+
+  snapshot->map = map;
+  snapshot->size = (size_t)st.st_size;
+  snapshot->num_events = header.num_events;
+  snapshot->log_offset = header.log_offset;
+  return 0;
+}
+
+int snapshot_next(struct Snapshot *snapshot, const struct SnapshotEvent **event, unsigned int **seats,
+                  uint64_t **occupied) {
+  if (snapshot->size - snapshot->pos < sizeof(struct SnapshotEvent)) {
+    return 1;
+  }
+  const struct SnapshotEvent *header = (const struct SnapshotEvent *)(snapshot->map + snapshot->pos);
+
+  if (header->rows > UINT32_MAX || header->cols > UINT32_MAX) {
+    return 1;
+  }
+  uint64_t num_seats = header->rows * header->cols;
+  size_t size = sizeof(struct SnapshotEvent) + seats_size(num_seats) + OCCUPIED_WORDS(num_seats) * sizeof(uint64_t);
+  if (snapshot->size - snapshot->pos < size) {
+    return 1;
+  }
+
+  char *data = snapshot->map + snapshot->pos + sizeof(struct SnapshotEvent);
+  *event = header;
+  *seats = (unsigned int *)data;
+  *occupied = (uint64_t *)(data + seats_size(num_seats));
+  snapshot->pos += size;
+  return 0;
+}
+
+void snapshot_close(struct Snapshot *snapshot) {
+  if (snapshot->map != NULL) {
+    munmap(snapshot->map, snapshot->size);
+    snapshot->map = NULL;
+  }
+}
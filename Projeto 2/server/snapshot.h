@@ -0,0 +1,78 @@
+#ifndef SERVER_SNAPSHOT_H
+#define SERVER_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Formato do ficheiro: uma struct SnapshotHeader seguida dos eventos, por
+// ordem de criação. Cada evento é uma struct SnapshotEvent seguida dos
+// lugares (uint32, linha a linha, completados até múltiplo de 8 bytes) e do
+// bitmap de ocupação (uint64). Tudo fica alinhado, para ser usado diretamente
+// a partir do mapeamento do ficheiro.
+#define SNAPSHOT_MAGIC "EMSSNAP1"
+
+struct SnapshotHeader {
+  char magic[8];
+  uint64_t num_events;
+  uint64_t log_offset;  // Bytes do log já refletidos nos eventos
+};
+
+struct SnapshotEvent {
+  uint32_t id;
+  uint32_t reservations;
+  uint64_t rows;
+  uint64_t cols;
+};
+
+/// Snapshot being written to a temporary file.
+struct SnapshotWriter {
+  FILE *file;
+  char *path;       // Path the snapshot replaces when finished
+  char *tmp_path;
+  uint64_t num_events;
+};
+
+/// Snapshot mapped in memory, read event by event.
+struct Snapshot {
+  char *map;   // Private mapping, the seats can be changed in place
+  size_t size;
+  size_t pos;  // Offset of the next event
+  uint64_t num_events;
+  uint64_t log_offset;
+};
+
+/// Starts writing a snapshot, to a temporary file next to its path.
+/// @return 0 if the file was created successfully, 1 otherwise.
+int snapshot_begin(struct SnapshotWriter *writer, const char *path);
+
+/// Adds an event to a snapshot.
+/// @param event Header of the event.
+/// @param seats Reservation id of each seat, row by row.
+/// @param occupied Occupancy bitmap of the seats.
+/// @return 0 if the event was written successfully, 1 otherwise.
+int snapshot_add(struct SnapshotWriter *writer, const struct SnapshotEvent *event, const unsigned int *seats,
+                 const uint64_t *occupied);
+
+/// Makes a snapshot durable and puts it in place of the previous one.
+/// @param log_offset Size of the log already reflected in the snapshot.
+/// @return 0 if the snapshot was saved successfully, 1 otherwise.
+int snapshot_finish(struct SnapshotWriter *writer, uint64_t log_offset);
+
+/// Discards a snapshot being written.
+void snapshot_abort(struct SnapshotWriter *writer);
+
+/// Maps a snapshot. A missing file is an empty snapshot.
+/// @return 0 if the snapshot was mapped successfully, 1 otherwise.
+int snapshot_open(struct Snapshot *snapshot, const char *path);
+
+/// Reads the next event of a snapshot. The seats and the bitmap point into
+/// the mapping, and stay valid until snapshot_close.
+/// @return 0 if an event was read, 1 if the snapshot is truncated.
+int snapshot_next(struct Snapshot *snapshot, const struct SnapshotEvent **event, unsigned int **seats,
+                  uint64_t **occupied);
+
+/// Unmaps a snapshot.
+void snapshot_close(struct Snapshot *snapshot);
+
+#endif  // SERVER_SNAPSHOT_H
@@ -0,0 +1,246 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/constants.h"
+
+#define STATS_TEXT_SIZE 4096
+
+/// Statistics of one thread, in their own cache lines.
+struct ThreadStats {
+  _Alignas(64) struct OpStats ops[STATS_OPS];
+};
+
+// Estatísticas de cada thread que já tratou um pedido, lidas pelo STATS
+static _Atomic(struct ThreadStats *) threads[MAX_WORKER_COUNT];
+static _Atomic size_t num_threads = 0;
+
+static _Thread_local struct ThreadStats *local = NULL;
+
+// Pedido a ser tratado pela thread
+static _Thread_local struct {
+  uint64_t lock_wait_ns;
+  uint64_t lock_waits;
+  uint64_t conflicts;
+  uint64_t failures;
+  uint64_t bytes_out;
+} current;
+
+static const char *op_names[STATS_OPS] = {"SETUP", "CREATE", "RESERVE", "RESERVE_BATCH", "SHOW", "LIST"};
+static const char *phase_names[STATS_PHASES] = {"queue", "lock", "exec"};
+
+/// Adds to a counter written only by its thread: no atomic read-modify-write
+/// is needed, the atomic accesses only make the reads by STATS well defined.
+static void add(_Atomic uint64_t *counter, uint64_t value) {
+  uint64_t old = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, old + value, memory_order_relaxed);
+}
+
+static size_t bucket_of(uint64_t ns) {
+  if (ns < (1u << STATS_SUB_BITS)) {
+    return (size_t)ns;
+  }
+  unsigned int msb = 63 - (unsigned int)__builtin_clzll(ns);
+  return ((size_t)(msb - STATS_SUB_BITS + 1) << STATS_SUB_BITS) |
+         (size_t)((ns >> (msb - STATS_SUB_BITS)) & ((1u << STATS_SUB_BITS) - 1));
+}
+
+/// Largest value that falls in a bucket.
+static uint64_t bucket_max(size_t bucket) {
+  if (bucket < (1u << STATS_SUB_BITS)) {
+    return bucket;
+  }
+  unsigned int shift = (unsigned int)(bucket >> STATS_SUB_BITS) - 1;
+  uint64_t low = (uint64_t)((1u << STATS_SUB_BITS) | (bucket & ((1u << STATS_SUB_BITS) - 1))) << shift;
+  return low + ((uint64_t)1 << shift) - 1;
+}
+
+/// Gets the statistics of the calling thread, registering them on first use.
+static struct ThreadStats *thread_stats(void) {
+  if (local != NULL) {
+    return local;
+  }
+  size_t index = atomic_fetch_add(&num_threads, 1);
+  if (index >= MAX_WORKER_COUNT) {
+    return NULL;
+  }
+  local = aligned_alloc(64, sizeof(struct ThreadStats));
+  if (local == NULL) {
+    return NULL;
+  }
+  memset(local, 0, sizeof(struct ThreadStats));
+  // Os contadores ficam a zero antes de o STATS os poder ler
+  atomic_store_explicit(&threads[index], local, memory_order_release);
+  return local;
+}
+
+uint64_t stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+uint64_t stats_begin(void) {
+  memset(&current, 0, sizeof(current));
+  return stats_now();
+}
+
+void stats_lock_wait(uint64_t ns) {
+  current.lock_wait_ns += ns;
+  current.lock_waits++;
+}
+
+void stats_conflict(void) { current.conflicts++; }
+
+void stats_response(const char *response, size_t size) {
+  int result = 0;
+  if (size >= sizeof(int)) {
+    memcpy(&result, response, sizeof(int));
+  }
+  if (result != 0) {
+    current.failures++;
+  }
+  current.bytes_out += sizeof(size_t) + size;
+}
+
+void stats_end(enum StatsOp op, uint64_t ready_ns, uint64_t start_ns, size_t bytes_in) {
+  if (op >= STATS_OPS) {
+    return;
+  }
+  struct ThreadStats *stats = thread_stats();
+  if (stats == NULL) {
+    return;
+  }
+  uint64_t end_ns = stats_now();
+  uint64_t busy = end_ns - start_ns;
+  uint64_t lock = current.lock_wait_ns < busy ? current.lock_wait_ns : busy;
+
+  struct OpStats *op_stats = &stats->ops[op];
+  add(&op_stats->count, 1);
+  add(&op_stats->failures, current.failures);
+  add(&op_stats->conflicts, current.conflicts);
+  add(&op_stats->lock_waits, current.lock_waits);
+  add(&op_stats->bytes_in, bytes_in);
+  add(&op_stats->bytes_out, current.bytes_out);
+  add(&op_stats->histograms[STATS_QUEUE][bucket_of(start_ns > ready_ns ? start_ns - ready_ns : 0)], 1);
+  add(&op_stats->histograms[STATS_LOCK][bucket_of(lock)], 1);
+  add(&op_stats->histograms[STATS_EXEC][bucket_of(busy - lock)], 1);
+}
+
+static void append(char *text, size_t *len, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(text + *len, STATS_TEXT_SIZE - *len, format, args);
+  va_end(args);
+  if (written > 0) {
+    *len += (size_t)written < STATS_TEXT_SIZE - *len ? (size_t)written : STATS_TEXT_SIZE - *len - 1;
+  }
+}
+
+/// Value below which a fraction of the samples falls, in microseconds.
+static double percentile(const uint64_t *histogram, uint64_t count, double fraction) {
+  uint64_t target = (uint64_t)((double)count * fraction);
+  if (target == 0) {
+    target = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < STATS_BUCKETS; i++) {
+    seen += histogram[i];
+    if (seen >= target) {
+      return (double)bucket_max(i) / 1000.0;
+    }
+  }
+  return 0;
+}
+
+/// Totals of one operation over every thread.
+struct OpTotals {
+  uint64_t count;
+  uint64_t failures;
+  uint64_t conflicts;
+  uint64_t lock_waits;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t histograms[STATS_PHASES][STATS_BUCKETS];
+};
+
+/// Sums an operation over every thread. The threads keep going, so the
+/// values of each one may be from slightly different moments.
+static void merge_op(enum StatsOp op, size_t count, struct OpTotals *totals) {
+  memset(totals, 0, sizeof(*totals));
+  for (size_t t = 0; t < count; t++) {
+    struct ThreadStats *stats = atomic_load_explicit(&threads[t], memory_order_acquire);
+    if (stats == NULL) {
+      continue;
+    }
+    struct OpStats *op_stats = &stats->ops[op];
+    totals->count += atomic_load_explicit(&op_stats->count, memory_order_relaxed);
+    totals->failures += atomic_load_explicit(&op_stats->failures, memory_order_relaxed);
+    totals->conflicts += atomic_load_explicit(&op_stats->conflicts, memory_order_relaxed);
+    totals->lock_waits += atomic_load_explicit(&op_stats->lock_waits, memory_order_relaxed);
+    totals->bytes_in += atomic_load_explicit(&op_stats->bytes_in, memory_order_relaxed);
+    totals->bytes_out += atomic_load_explicit(&op_stats->bytes_out, memory_order_relaxed);
+    for (int phase = 0; phase < STATS_PHASES; phase++) {
+      for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        totals->histograms[phase][i] += atomic_load_explicit(&op_stats->histograms[phase][i], memory_order_relaxed);
+      }
+    }
+  }
+}
+
+int stats_format(char **text, size_t *size) {
+  char *out = malloc(STATS_TEXT_SIZE);
+  struct OpTotals *totals = malloc(STATS_OPS * sizeof(struct OpTotals));
+  if (out == NULL || totals == NULL) {
+    free(out);
+    free(totals);
+    return 1;
+  }
+  size_t count = atomic_load(&num_threads);
+  if (count > MAX_WORKER_COUNT) {
+    count = MAX_WORKER_COUNT;
+  }
+  for (int op = 0; op < STATS_OPS; op++) {
+    merge_op((enum StatsOp)op, count, &totals[op]);
+  }
+
+  size_t len = 0;
+  append(out, &len, "%-14s %10s %10s %10s %10s %12s %12s\n", "op", "count", "failures", "conflicts", "lock_waits",
+         "bytes_in", "bytes_out");
+  for (int op = 0; op < STATS_OPS; op++) {
+    append(out, &len, "%-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+           op_names[op], totals[op].count, totals[op].failures, totals[op].conflicts, totals[op].lock_waits,
+           totals[op].bytes_in, totals[op].bytes_out);
+  }
+
+  append(out, &len, "%-14s %-6s %10s %10s %10s %10s %10s\n", "latency (us)", "phase", "p50", "p90", "p99", "p99.9",
+         "max");
+  for (int op = 0; op < STATS_OPS; op++) {
+    for (int phase = 0; phase < STATS_PHASES && totals[op].count > 0; phase++) {
+      // Os histogramas podem ter mais uma amostra que o contador, conta-as outra vez
+      const uint64_t *histogram = totals[op].histograms[phase];
+      uint64_t samples = 0;
+      size_t last = 0;
+      for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        samples += histogram[i];
+        if (histogram[i] > 0) {
+          last = i;
+        }
+      }
+      append(out, &len, "%-14s %-6s %10.1f %10.1f %10.1f %10.1f %10.1f\n", op_names[op], phase_names[phase],
+             percentile(histogram, samples, 0.5), percentile(histogram, samples, 0.9),
+             percentile(histogram, samples, 0.99), percentile(histogram, samples, 0.999),
+             (double)bucket_max(last) / 1000.0);
+    }
+  }
+  free(totals);
+
+  *text = out;
+  *size = len;
+  return 0;
+}
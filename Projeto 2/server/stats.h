@@ -0,0 +1,75 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Histogramas log-lineares (como o HdrHistogram): cada potência de 2 de
+// nanossegundos é dividida em 2^STATS_SUB_BITS intervalos, com um erro
+// relativo máximo de 12.5%. Valores abaixo de 2^STATS_SUB_BITS são exatos.
+#define STATS_SUB_BITS 3
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+/// Operations with their own statistics.
+enum StatsOp {
+  STATS_SETUP,
+  STATS_CREATE,
+  STATS_RESERVE,
+  STATS_RESERVE_BATCH,
+  STATS_SHOW,
+  STATS_LIST,
+  STATS_OPS  // Number of operations, also used for requests not counted
+};
+
+/// Parts of the latency of a request.
+enum StatsPhase {
+  STATS_QUEUE,  // From the request being seen by the event loop to a worker starting it
+  STATS_LOCK,   // Waiting for contended locks of the EMS state
+  STATS_EXEC,   // The rest of the time spent by the worker
+  STATS_PHASES
+};
+
+/// Statistics of one operation, written only by the thread that owns them.
+struct OpStats {
+  _Atomic uint64_t count;
+  _Atomic uint64_t failures;    // Responses with an error
+  _Atomic uint64_t conflicts;   // Events that already existed or seats already reserved
+  _Atomic uint64_t lock_waits;  // Locks that were not free
+  _Atomic uint64_t bytes_in;    // Requests, with their size prefix
+  _Atomic uint64_t bytes_out;   // Responses, with their size prefix
+  _Atomic uint64_t histograms[STATS_PHASES][STATS_BUCKETS];
+};
+
+/// Current time in nanoseconds, from a monotonic clock.
+uint64_t stats_now(void);
+
+/// Starts counting a request in the calling thread.
+/// @return The current time, to pass to stats_end.
+uint64_t stats_begin(void);
+
+/// Adds time spent waiting for a lock to the current request.
+void stats_lock_wait(uint64_t ns);
+
+/// Counts a conflict in the current request.
+void stats_conflict(void);
+
+/// Counts a response to the current request.
+/// @param response Response, starting with its result.
+/// @param size Size of the response.
+void stats_response(const char *response, size_t size);
+
+/// Records the current request of the calling thread.
+/// @param op Operation of the request, or STATS_OPS to discard it.
+/// @param ready_ns When the request was seen by the event loop.
+/// @param start_ns When the worker started it, as given to stats_begin.
+/// @param bytes_in Size of the request.
+void stats_end(enum StatsOp op, uint64_t ready_ns, uint64_t start_ns, size_t bytes_in);
+
+/// Merges the statistics of every thread in a table, without stopping them.
+/// @param text Pointer to store the table in, allocated with malloc.
+/// @param size Pointer to store the length of the table in.
+/// @return 0 if the table was written successfully, 1 otherwise.
+int stats_format(char **text, size_t *size);
+
+#endif  // SERVER_STATS_H
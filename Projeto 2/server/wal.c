@@ -0,0 +1,238 @@
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAL_INITIAL_CAPACITY 4096
+#define CHECKSUM_INIT 2166136261u  // FNV-1a, 32 bits
+
+static uint32_t checksum_update(uint32_t hash, const char *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+  return 0;
+}
+
+/// Applies the records of a mapped log, from an offset.
+/// @return Size of the valid prefix of the log, or -1 if a record failed to apply.
+static off_t replay(const char *log, size_t size, size_t start, wal_apply_fn apply) {
+  size_t pos = start;
+  while (size - pos >= WAL_HEADER_SIZE) {
+    uint32_t record_size, checksum;
+    memcpy(&record_size, log + pos, sizeof(uint32_t));
+    memcpy(&checksum, log + pos + sizeof(uint32_t), sizeof(uint32_t));
+    const char *record = log + pos + WAL_HEADER_SIZE;
+
+    if (record_size == 0 || record_size > size - pos - WAL_HEADER_SIZE ||
+        checksum_update(CHECKSUM_INIT, record, record_size) != checksum) {
+      break;
+    }
+    if (apply(record, record_size) != 0) {
+      return -1;
+    }
+    pos += WAL_HEADER_SIZE + record_size;
+  }
+  return (off_t)pos;
+}
+
+int wal_open(struct Wal *wal, const char *path, uint64_t start, wal_apply_fn apply) {
+  // O_APPEND: as escritas vão sempre para o fim, mesmo depois de cortar um registo incompleto
+  wal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (wal->fd == -1) {
+    fprintf(stderr, "Error opening log %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(wal->fd, &st) == -1) {
+    fprintf(stderr, "Error reading log %s: %s\n", path, strerror(errno));
+    close(wal->fd);
+    return 1;
+  }
+
+  if ((uint64_t)st.st_size < start) {
+    fprintf(stderr, "Log %s is shorter than the state it should continue\n", path);
+    close(wal->fd);
+    return 1;
+  }
+  off_t end = st.st_size;
+
+  if ((uint64_t)st.st_size > start) {
+    const char *log = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, wal->fd, 0);
+    if (log == MAP_FAILED) {
+      fprintf(stderr, "Error reading log %s: %s\n", path, strerror(errno));
+      close(wal->fd);
+      return 1;
+    }
+    end = replay(log, (size_t)st.st_size, start, apply);
+    munmap((void *)log, (size_t)st.st_size);
+
+    if (end == -1) {
+      fprintf(stderr, "Invalid record in log %s\n", path);
+      close(wal->fd);
+      return 1;
+    }
+    if (end < st.st_size) {
+      fprintf(stderr, "Discarding incomplete record at the end of log %s\n", path);
+      if (ftruncate(wal->fd, end) == -1 || fdatasync(wal->fd) == -1) {
+        fprintf(stderr, "Error truncating log %s: %s\n", path, strerror(errno));
+        close(wal->fd);
+        return 1;
+      }
+    }
+  }
+
+  wal->buffer = malloc(WAL_INITIAL_CAPACITY);
+  wal->spare = malloc(WAL_INITIAL_CAPACITY);
+  if (wal->buffer == NULL || wal->spare == NULL) {
+    free(wal->buffer);
+    free(wal->spare);
+    close(wal->fd);
+    return 1;
+  }
+  wal->len = 0;
+  wal->cap = WAL_INITIAL_CAPACITY;
+  wal->spare_cap = WAL_INITIAL_CAPACITY;
+  wal->appended = 0;
+  wal->size = (uint64_t)end;
+  wal->durable = 0;
+  wal->flushing = 0;
+  wal->failed = 0;
+
+  if (pthread_mutex_init(&wal->mutex, NULL) != 0 || pthread_cond_init(&wal->cond, NULL) != 0) {
+    fprintf(stderr, "Error initializing log mutex\n");
+    free(wal->buffer);
+    free(wal->spare);
+    close(wal->fd);
+    return 1;
+  }
+  return 0;
+}
+
+void wal_close(struct Wal *wal) {
+  pthread_mutex_destroy(&wal->mutex);
+  pthread_cond_destroy(&wal->cond);
+  free(wal->buffer);
+  free(wal->spare);
+  close(wal->fd);
+}
+
+uint64_t wal_append(struct Wal *wal, const struct iovec *parts, int num_parts) {
+  size_t size = 0;
+  uint32_t checksum = CHECKSUM_INIT;
+  for (int i = 0; i < num_parts; i++) {
+    size += parts[i].iov_len;
+    checksum = checksum_update(checksum, parts[i].iov_base, parts[i].iov_len);
+  }
+  if (size == 0 || size > UINT32_MAX) {
+    return 0;
+  }
+  uint32_t record_size = (uint32_t)size;
+
+  pthread_mutex_lock(&wal->mutex);
+  if (wal->failed) {
+    pthread_mutex_unlock(&wal->mutex);
+    return 0;
+  }
+
+  // Só este buffer cresce, o outro pode estar a ser escrito pelo líder
+  if (wal->cap - wal->len < WAL_HEADER_SIZE + size) {
+    size_t cap = wal->cap;
+    while (cap - wal->len < WAL_HEADER_SIZE + size) {
+      cap *= 2;
+    }
+    char *bigger = realloc(wal->buffer, cap);
+    if (bigger == NULL) {
+      pthread_mutex_unlock(&wal->mutex);
+      return 0;
+    }
+    wal->buffer = bigger;
+    wal->cap = cap;
+  }
+
+  char *out = wal->buffer + wal->len;
+  memcpy(out, &record_size, sizeof(uint32_t));
+  memcpy(out + sizeof(uint32_t), &checksum, sizeof(uint32_t));
+  out += WAL_HEADER_SIZE;
+  for (int i = 0; i < num_parts; i++) {
+    memcpy(out, parts[i].iov_base, parts[i].iov_len);
+    out += parts[i].iov_len;
+  }
+  wal->len += WAL_HEADER_SIZE + size;
+  wal->size += WAL_HEADER_SIZE + size;
+  uint64_t lsn = ++wal->appended;
+
+  pthread_mutex_unlock(&wal->mutex);
+  return lsn;
+}
+
+uint64_t wal_last(struct Wal *wal, uint64_t *size) {
+  pthread_mutex_lock(&wal->mutex);
+  uint64_t lsn = wal->appended;
+  if (size != NULL) {
+    *size = wal->size;
+  }
+  pthread_mutex_unlock(&wal->mutex);
+  return lsn;
+}
+
+int wal_commit(struct Wal *wal, uint64_t lsn) {
+  pthread_mutex_lock(&wal->mutex);
+  while (wal->durable < lsn && !wal->failed) {
+    if (wal->flushing) {
+      // O grupo em escrita pode não incluir este registo, volta a verificar no fim
+      pthread_cond_wait(&wal->cond, &wal->mutex);
+      continue;
+    }
+
+    // Esta thread é o líder: escreve tudo o que foi adicionado até agora,
+    // enquanto as outras continuam a adicionar ao outro buffer
+    char *group = wal->buffer;
+    size_t group_len = wal->len;
+    size_t group_cap = wal->cap;
+    uint64_t group_end = wal->appended;
+    wal->buffer = wal->spare;
+    wal->cap = wal->spare_cap;
+    wal->len = 0;
+    wal->flushing = 1;
+    pthread_mutex_unlock(&wal->mutex);
+
+    int error = write_all(wal->fd, group, group_len) != 0 || fdatasync(wal->fd) != 0;
+    int write_errno = errno;
+
+    pthread_mutex_lock(&wal->mutex);
+    wal->spare = group;
+    wal->spare_cap = group_cap;
+    wal->flushing = 0;
+    if (error) {
+      fprintf(stderr, "Error writing log: %s\n", strerror(write_errno));
+      wal->failed = 1;
+    } else {
+      wal->durable = group_end;
+    }
+    pthread_cond_broadcast(&wal->cond);
+  }
+  int result = wal->durable < lsn;
+  pthread_mutex_unlock(&wal->mutex);
+  return result;
+}
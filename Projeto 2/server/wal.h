@@ -0,0 +1,76 @@
+#ifndef SERVER_WAL_H
+#define SERVER_WAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Formato de cada registo no ficheiro:
+//   tamanho do conteúdo (uint32), checksum FNV-1a do conteúdo (uint32),
+//   seguidos do conteúdo, que começa pelo tipo (1 byte).
+// Um registo incompleto ou com checksum errado no fim do ficheiro é de uma
+// escrita interrompida, e é descartado ao abrir o log.
+#define WAL_CREATE 'C'   // id do evento, linhas, colunas
+#define WAL_RESERVE 'R'  // id do evento, id da reserva, número de lugares, linhas, colunas
+#define WAL_HEADER_SIZE (2 * sizeof(uint32_t))
+
+/// Append-only log of the operations that change the EMS state, made
+/// durable in groups: one fdatasync covers every record appended before it.
+struct Wal {
+  int fd;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;    // Threads à espera que um grupo chegue ao disco
+  char *buffer;           // Registos ainda não escritos
+  size_t len;
+  size_t cap;
+  char *spare;            // Buffer a ser escrito pelo líder, ou livre
+  size_t spare_cap;
+  uint64_t appended;      // Número do último registo adicionado
+  uint64_t size;          // Bytes do log, contando os que ainda estão no buffer
+  uint64_t durable;       // Número do último registo em disco
+  int flushing;           // Há uma thread a escrever um grupo
+  int failed;             // Uma escrita falhou, nada mais é garantido
+};
+
+/// Called for each record found when opening a log.
+/// @param record Content of the record, starting with its type.
+/// @param size Size of the content.
+/// @return 0 if the record was applied successfully, 1 otherwise.
+typedef int (*wal_apply_fn)(const char *record, size_t size);
+
+/// Opens a log, creating it if needed, and applies the records already in it.
+/// An incomplete record at the end, left by a crash, is removed.
+/// @param wal Log to initialize.
+/// @param path Path of the log file.
+/// @param start Offset of the first record to apply, as given by wal_last.
+/// @param apply Function called with each record, in order.
+/// @return 0 if the log was opened and replayed successfully, 1 otherwise.
+int wal_open(struct Wal *wal, const char *path, uint64_t start, wal_apply_fn apply);
+
+/// Closes a log. Records not yet committed may be lost.
+void wal_close(struct Wal *wal);
+
+/// Adds a record to the log, in memory. Records are written in the order of
+/// the calls, so callers append while holding the lock of what they changed.
+/// @param wal Log to append to.
+/// @param parts Pieces of the content of the record, starting with its type.
+/// @param num_parts Number of pieces.
+/// @return Number of the record, to pass to wal_commit, or 0 on failure.
+uint64_t wal_append(struct Wal *wal, const struct iovec *parts, int num_parts);
+
+/// Gets the position of the end of the log.
+/// @param wal Log to read.
+/// @param size Pointer to store the size of the log in, counting the records
+/// not yet written, or NULL.
+/// @return Number of the last record appended, to pass to wal_commit.
+uint64_t wal_last(struct Wal *wal, uint64_t *size);
+
+/// Blocks until a record, and every record before it, is on disk. Threads
+/// that commit at the same time share the write and the fdatasync.
+/// @param wal Log the record was appended to.
+/// @param lsn Number returned by wal_append.
+/// @return 0 if the record is durable, 1 otherwise.
+int wal_commit(struct Wal *wal, uint64_t lsn);
+
+#endif  // SERVER_WAL_H
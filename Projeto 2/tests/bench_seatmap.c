@@ -0,0 +1,101 @@
+// Microbenchmark do formato dos mapas de lugares do SHOW: para vários tipos
+// de sala, mede o tamanho codificado e o débito de seatmap_encode e
+// seatmap_decode, em milhões de lugares por segundo.
+// Uso: bench_seatmap [linhas] [colunas] [iterações]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/seatmap.h"
+
+/// Fills a venue according to its kind.
+static void fill(unsigned int *seats, size_t num_seats, int kind) {
+  for (size_t i = 0; i < num_seats; i++) {
+    switch (kind) {
+      case 0:  // Vazia
+        seats[i] = 0;
+        break;
+      case 1:  // 10% ocupada, em blocos de 10 lugares
+        seats[i] = (i / 10) % 10 == 0 ? (unsigned int)(i / 100) + 1 : 0;
+        break;
+      case 2:  // Cheia, ids < 256
+        seats[i] = (unsigned int)(i % 255) + 1;
+        break;
+      case 3:  // Cheia, ids < 64K
+        seats[i] = (unsigned int)(i % 65535) + 1;
+        break;
+      default:  // Cheia, um id diferente por lugar
+        seats[i] = (unsigned int)i + 1;
+        break;
+    }
+  }
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *kinds[] = {"empty", "10% booked, blocks of 10", "full, ids < 256", "full, ids < 64K",
+                                "full, distinct ids"};
+  size_t rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+  size_t cols = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+  int iterations = argc > 3 ? atoi(argv[3]) : 20;
+  size_t num_seats = rows * cols;
+  size_t max_size = seatmap_max_size(rows, cols);
+  if (num_seats == 0 || max_size == 0 || iterations <= 0) {
+    fprintf(stderr, "Usage: %s [rows] [cols] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int *seats = malloc(num_seats * sizeof(unsigned int));
+  char *encoded = malloc(max_size);
+  if (seats == NULL || encoded == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+
+  // O formato anterior mandava linhas, colunas e cada lugar como size_t
+  size_t old_size = (2 + num_seats) * sizeof(size_t);
+  printf("%zux%zu venue, %d iterations, previous format %zu B\n", rows, cols, iterations, old_size);
+  printf("%-26s %10s %-8s %12s %12s\n", "venue", "bytes", "format", "enc Mseats/s", "dec Mseats/s");
+
+  for (int kind = 0; kind < 5; kind++) {
+    fill(seats, num_seats, kind);
+
+    struct timespec start;
+    size_t size = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+      size = seatmap_encode(encoded, rows, cols, seats);
+    }
+    double encode_s = seconds_since(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+      size_t out_rows, out_cols;
+      unsigned int *decoded;
+      if (seatmap_decode(encoded, size, &out_rows, &out_cols, &decoded) != 0) {
+        fprintf(stderr, "Failed to decode the %s venue\n", kinds[kind]);
+        return 1;
+      }
+      free(decoded);
+    }
+    double decode_s = seconds_since(&start);
+
+    double total = (double)num_seats * iterations / 1e6;
+    // Em RAW o terceiro byte do cabeçalho diz quantos bytes tem cada lugar
+    char format[16] = "RLE";
+    if (encoded[1] == SEATMAP_RAW) {
+      snprintf(format, sizeof(format), "RAW%d", encoded[2]);
+    }
+    printf("%-26s %10zu %-8s %12.0f %12.0f\n", kinds[kind], size, format, total / encode_s, total / decode_s);
+  }
+
+  free(seats);
+  free(encoded);
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Gerador de carga com vários clientes: para cada número de clientes de 1 a
+// N, lança um processo por cliente, cada um com a sua sessão e o seu evento,
+// e mede os pedidos por segundo que o servidor responde no total.
+// Cada cliente faz um CREATE, reserva um lugar de cada vez e acaba com um SHOW.
+// Uso: loadgen <server_pipe> [máximo de clientes] [reservas por cliente]
+// O servidor deve ter pelo menos tantos workers como clientes, por exemplo
+// ./server/ems /tmp/s.pipe 2000 5, para a escala não ficar limitada por eles.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+
+/// Runs one client on its own event.
+/// @return 0 if every request succeeded, 1 otherwise.
+static int run_client(const char *server_pipe, unsigned int event_id, size_t num_reserves) {
+  char req_pipe[64], resp_pipe[64];
+  snprintf(req_pipe, sizeof(req_pipe), "/tmp/loadgen_%d_req.pipe", getpid());
+  snprintf(resp_pipe, sizeof(resp_pipe), "/tmp/loadgen_%d_resp.pipe", getpid());
+
+  if (ems_setup(req_pipe, resp_pipe, server_pipe)) {
+    fprintf(stderr, "Failed to set up EMS\n");
+    return 1;
+  }
+  int failed = ems_create(event_id, 1, num_reserves);
+  for (size_t i = 0; i < num_reserves && !failed; i++) {
+    size_t x = 1, y = i + 1;
+    failed = ems_reserve(event_id, 1, &x, &y);
+  }
+
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (!failed && (null_fd == -1 || ems_show(null_fd, event_id))) {
+    failed = 1;
+  }
+  if (null_fd != -1) {
+    close(null_fd);
+  }
+  return ems_quit() || failed;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <server_pipe> [max clients] [reserves per client]\n", argv[0]);
+    return 1;
+  }
+  int max_clients = argc > 2 ? atoi(argv[2]) : 5;
+  int num_reserves = argc > 3 ? atoi(argv[3]) : 50;
+  if (max_clients <= 0 || num_reserves <= 0) {
+    fprintf(stderr, "Usage: %s <server_pipe> [max clients] [reserves per client]\n", argv[0]);
+    return 1;
+  }
+
+  printf("clients  requests  seconds     req/s\n");
+  for (int clients = 1; clients <= max_clients; clients++) {
+    // Os filhos não podem herdar texto por escrever
+    fflush(stdout);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int c = 0; c < clients; c++) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        fprintf(stderr, "Failed to fork\n");
+        return 1;
+      }
+      if (pid == 0) {
+        // Cada ronda usa eventos novos, o servidor pode ficar a correr entre execuções
+        unsigned int event_id = (unsigned int)getpid() * 1000u + (unsigned int)c + 1;
+        exit(run_client(argv[1], event_id, (size_t)num_reserves));
+      }
+    }
+
+    int failed = 0;
+    for (int c = 0; c < clients; c++) {
+      int status;
+      if (wait(&status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        failed = 1;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (failed) {
+      fprintf(stderr, "A client failed with %d clients\n", clients);
+      return 1;
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    long requests = (long)clients * (num_reserves + 2);
+    printf("%7d  %8ld  %7.3f  %8.0f\n", clients, requests, seconds, (double)requests / seconds);
+  }
+  return 0;
+}